@@ -0,0 +1,266 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "app_catalog.h"
+#include "connection.h"
+
+#include <Limelight.h>
+
+#include <errors.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Milliseconds before a list is refreshed in the background
+#define APP_CATALOG_TTL 60000
+// Milliseconds before a failed first fetch is tried again
+#define APP_CATALOG_RETRY 5000
+
+static pthread_mutex_t catalog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static APP_CATALOG* current;
+static uint64_t fetched_at, generation;
+// Bumped by invalidation, so a refresh for the previous host is discarded
+static uint64_t epoch;
+static bool refreshing, failed;
+
+// One allocation holds the snapshot, the name and id arrays and the names
+static APP_CATALOG* app_catalog_build(PAPP_LIST list) {
+  int count = 0;
+  size_t text_size = 0;
+  for (PAPP_LIST app = list; app != NULL; app = app->next) {
+    if (app->name == NULL)
+      continue;
+
+    count++;
+    text_size += strlen(app->name) + 1;
+  }
+
+  size_t size = sizeof(APP_CATALOG) + count * (sizeof(char*) + sizeof(int)) + text_size;
+  APP_CATALOG* catalog = malloc(size);
+  if (catalog == NULL)
+    return NULL;
+
+  const char** names = (const char**) (catalog + 1);
+  int* ids = (int*) (names + count);
+  char* text = (char*) (ids + count);
+
+  // The host's list arrives reversed, keep the order the host shows
+  int i = count;
+  for (PAPP_LIST app = list; app != NULL; app = app->next) {
+    if (app->name == NULL)
+      continue;
+
+    i--;
+    size_t length = strlen(app->name) + 1;
+    memcpy(text, app->name, length);
+    names[i] = text;
+    ids[i] = app->id;
+    text += length;
+  }
+
+  catalog->count = count;
+  catalog->names = names;
+  catalog->ids = ids;
+  catalog->refs = 1;
+  return catalog;
+}
+
+static void app_catalog_free_list(PAPP_LIST list) {
+  while (list != NULL) {
+    PAPP_LIST next = list->next;
+    free(list->name);
+    free(list);
+    list = next;
+  }
+}
+
+static APP_CATALOG* app_catalog_fetch(PSERVER_DATA server) {
+  PAPP_LIST list = NULL;
+
+  connection_lock();
+  int ret = gs_applist(server, &list);
+  connection_unlock();
+
+  if (ret != GS_OK) {
+    fprintf(stderr, "Can't get app list\n");
+    app_catalog_free_list(list);
+    return NULL;
+  }
+
+  APP_CATALOG* catalog = app_catalog_build(list);
+  app_catalog_free_list(list);
+  if (catalog == NULL)
+    fprintf(stderr, "Not enough memory for the app list\n");
+
+  return catalog;
+}
+
+// Wakes up the menu to show the new list
+static void app_catalog_notify(void) {
+#ifdef HAVE_SDL
+  SDL_Event event = {0};
+  event.type = SDL_USEREVENT;
+  event.user.code = SDL_CODE_APPS;
+  SDL_PushEvent(&event);
+#endif
+}
+
+// Call with catalog_mutex held, takes over the reference to catalog
+static void app_catalog_publish(APP_CATALOG* catalog) {
+  APP_CATALOG* previous = current;
+  catalog->generation = ++generation;
+  current = catalog;
+  fetched_at = LiGetMillis();
+  failed = false;
+
+  if (previous)
+    app_catalog_release(previous);
+
+  app_catalog_notify();
+}
+
+// The refresh works on its own copy of the host, the caller's one may
+// change while the thread runs
+typedef struct _APP_CATALOG_REFRESH {
+  SERVER_DATA server;
+  uint64_t epoch;
+} APP_CATALOG_REFRESH;
+
+static void* app_catalog_refresh(void* arg) {
+  APP_CATALOG_REFRESH* refresh = arg;
+  APP_CATALOG* catalog = app_catalog_fetch(&refresh->server);
+
+  pthread_mutex_lock(&catalog_mutex);
+  if (catalog && refresh->epoch == epoch)
+    app_catalog_publish(catalog);
+  else if (catalog)
+    app_catalog_release(catalog);
+  // A failed refresh keeps the old list until the TTL expires again
+  else if (refresh->epoch == epoch) {
+    fetched_at = LiGetMillis();
+    // Without a list the menu switches from loading to the error
+    if (current == NULL) {
+      failed = true;
+      generation++;
+      app_catalog_notify();
+    }
+  }
+
+  refreshing = false;
+  pthread_mutex_unlock(&catalog_mutex);
+
+  free(refresh);
+  return NULL;
+}
+
+// Call with catalog_mutex held
+static void app_catalog_start_refresh(PSERVER_DATA server) {
+  APP_CATALOG_REFRESH* refresh = malloc(sizeof(APP_CATALOG_REFRESH));
+  if (refresh == NULL)
+    return;
+
+  refresh->server = *server;
+  refresh->epoch = epoch;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, app_catalog_refresh, refresh) != 0) {
+    free(refresh);
+    return;
+  }
+
+  pthread_detach(thread);
+  refreshing = true;
+}
+
+const APP_CATALOG* app_catalog_acquire(PSERVER_DATA server) {
+  pthread_mutex_lock(&catalog_mutex);
+  uint64_t age = LiGetMillis() - fetched_at;
+  bool stale = current ? age > APP_CATALOG_TTL : !failed || age > APP_CATALOG_RETRY;
+  if (!refreshing && stale)
+    app_catalog_start_refresh(server);
+
+  APP_CATALOG* catalog = current;
+  if (catalog)
+    __atomic_fetch_add(&catalog->refs, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&catalog_mutex);
+
+  return catalog;
+}
+
+const APP_CATALOG* app_catalog_acquire_sync(PSERVER_DATA server) {
+  pthread_mutex_lock(&catalog_mutex);
+  if (current) {
+    __atomic_fetch_add(&current->refs, 1, __ATOMIC_RELAXED);
+    APP_CATALOG* catalog = current;
+    pthread_mutex_unlock(&catalog_mutex);
+    return catalog;
+  }
+
+  uint64_t fetch_epoch = epoch;
+  pthread_mutex_unlock(&catalog_mutex);
+
+  APP_CATALOG* catalog = app_catalog_fetch(server);
+  if (catalog == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&catalog_mutex);
+  if (fetch_epoch == epoch && current == NULL) {
+    __atomic_fetch_add(&catalog->refs, 1, __ATOMIC_RELAXED);
+    app_catalog_publish(catalog);
+  }
+  pthread_mutex_unlock(&catalog_mutex);
+
+  return catalog;
+}
+
+void app_catalog_release(const APP_CATALOG* catalog) {
+  APP_CATALOG* owned = (APP_CATALOG*) catalog;
+  if (owned && __atomic_sub_fetch(&owned->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    free(owned);
+}
+
+void app_catalog_invalidate(void) {
+  pthread_mutex_lock(&catalog_mutex);
+  APP_CATALOG* previous = current;
+  current = NULL;
+  failed = false;
+  epoch++;
+  generation++;
+  pthread_mutex_unlock(&catalog_mutex);
+
+  app_catalog_release(previous);
+  app_catalog_notify();
+}
+
+uint64_t app_catalog_generation(void) {
+  pthread_mutex_lock(&catalog_mutex);
+  uint64_t value = generation;
+  pthread_mutex_unlock(&catalog_mutex);
+
+  return value;
+}
+
+bool app_catalog_loading(void) {
+  pthread_mutex_lock(&catalog_mutex);
+  bool value = refreshing && current == NULL;
+  pthread_mutex_unlock(&catalog_mutex);
+
+  return value;
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <client.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Snapshots are immutable and reference counted, the UI keeps using the
+// one it acquired while a newer one is fetched in the background
+typedef struct _APP_CATALOG {
+  int count;
+  const char** names;
+  const int* ids;
+  uint64_t generation;
+  int refs;
+} APP_CATALOG, *PAPP_CATALOG;
+
+// Returns the current app list of the host without blocking. When there is
+// none yet, or it is older than APP_CATALOG_TTL, it is fetched in the
+// background and SDL_CODE_APPS tells when it arrived. NULL until then.
+const APP_CATALOG* app_catalog_acquire(PSERVER_DATA server);
+// Same, but fetches the list right away when there is none. It waits for
+// the host, so never call it from the UI thread.
+const APP_CATALOG* app_catalog_acquire_sync(PSERVER_DATA server);
+void app_catalog_release(const APP_CATALOG* catalog);
+
+// Drop the list after pairing, unpairing or switching hosts
+void app_catalog_invalidate(void);
+
+// Changes whenever a new list replaces the current one, with SDL a
+// SDL_CODE_APPS user event is pushed as well
+uint64_t app_catalog_generation(void);
+// True while the first list of the host is being fetched
+bool app_catalog_loading(void);
@@ -21,11 +21,14 @@
 
 #include <Limelight.h>
 
+extern AUDIO_RENDERER_CALLBACKS audio_callbacks_fake;
 #ifdef HAVE_ALSA
 extern AUDIO_RENDERER_CALLBACKS audio_callbacks_alsa;
 #endif
 #ifdef HAVE_SDL
 extern AUDIO_RENDERER_CALLBACKS audio_callbacks_sdl;
+// Milliseconds of audio waiting to be played
+int sdl_audio_queued_ms(void);
 #endif
 #ifdef HAVE_PULSE
 extern AUDIO_RENDERER_CALLBACKS audio_callbacks_pulse;
@@ -0,0 +1,101 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio.h"
+#include "../latency.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <opus_multistream.h>
+
+// Audio the emulated device buffers before a write blocks
+#define SINK_BUFFER_US 40000
+
+static OpusMSDecoder* decoder;
+static short* pcmBuffer;
+static int samplesPerFrame;
+static int sampleRate;
+
+// When the sink will have played everything written so far
+static uint64_t sink_time;
+static uint64_t samples_played, underruns;
+
+static int fake_renderer_init(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, void* context, int arFlags) {
+  int rc;
+  decoder = opus_multistream_decoder_create(opusConfig->sampleRate, opusConfig->channelCount, opusConfig->streams, opusConfig->coupledStreams, opusConfig->mapping, &rc);
+  if (decoder == NULL) {
+    printf("Opus error from decoder creation: %d\n", rc);
+    return -1;
+  }
+
+  samplesPerFrame = opusConfig->samplesPerFrame;
+  sampleRate = opusConfig->sampleRate;
+  pcmBuffer = malloc(sizeof(short) * opusConfig->channelCount * samplesPerFrame);
+  if (pcmBuffer == NULL)
+    return -1;
+
+  sink_time = 0;
+  samples_played = underruns = 0;
+  return 0;
+}
+
+static void fake_renderer_cleanup() {
+  if (samples_played > 0)
+    printf("Fake audio: %.1f s played, %llu underruns\n", (double) samples_played / sampleRate, (unsigned long long) underruns);
+
+  if (decoder != NULL) {
+    opus_multistream_decoder_destroy(decoder);
+    decoder = NULL;
+  }
+
+  if (pcmBuffer != NULL) {
+    free(pcmBuffer);
+    pcmBuffer = NULL;
+  }
+}
+
+// Discards the samples but blocks like a real device playing them would
+static void fake_renderer_decode_and_play_sample(char* data, int length) {
+  int decodeLen = opus_multistream_decode(decoder, data, length, pcmBuffer, samplesPerFrame, 0);
+  if (decodeLen < 0) {
+    printf("Opus error from decode: %d\n", decodeLen);
+    return;
+  } else if (decodeLen == 0)
+    return;
+
+  uint64_t now = latency_now_us();
+  if (sink_time < now) {
+    // Ran dry, playback restarts from now
+    if (sink_time != 0)
+      underruns++;
+    sink_time = now;
+  }
+
+  sink_time += (uint64_t) decodeLen * 1000000 / sampleRate;
+  samples_played += decodeLen;
+  if (sink_time - now > SINK_BUFFER_US)
+    usleep(sink_time - now - SINK_BUFFER_US);
+}
+
+AUDIO_RENDERER_CALLBACKS audio_callbacks_fake = {
+  .init = fake_renderer_init,
+  .cleanup = fake_renderer_cleanup,
+  .decodeAndPlaySample = fake_renderer_decode_and_play_sample,
+  .capabilities = CAPABILITY_DIRECT_SUBMIT | CAPABILITY_SUPPORTS_ARBITRARY_AUDIO_DURATION,
+};
@@ -30,12 +30,14 @@ static short* pcmBuffer;
 static int samplesPerFrame;
 static SDL_AudioDeviceID dev;
 static int channelCount;
+static int sampleRate;
 
 static int sdl_renderer_init(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, void* context, int arFlags) {
   int rc;
   decoder = opus_multistream_decoder_create(opusConfig->sampleRate, opusConfig->channelCount, opusConfig->streams, opusConfig->coupledStreams, opusConfig->mapping, &rc);
 
   channelCount = opusConfig->channelCount;
+  sampleRate = opusConfig->sampleRate;
   samplesPerFrame = opusConfig->samplesPerFrame;
   pcmBuffer = malloc(sizeof(short) * channelCount * samplesPerFrame);
   if (pcmBuffer == NULL)
@@ -87,6 +89,13 @@ static void sdl_renderer_decode_and_play_sample(char* data, int length) {
   }
 }
 
+int sdl_audio_queued_ms(void) {
+  if (dev == 0)
+    return 0;
+
+  return SDL_GetQueuedAudioSize(dev) / (channelCount * sizeof(short)) * 1000 / sampleRate;
+}
+
 AUDIO_RENDERER_CALLBACKS audio_callbacks_sdl = {
   .init = sdl_renderer_init,
   .cleanup = sdl_renderer_cleanup,
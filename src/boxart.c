@@ -0,0 +1,387 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_SDL
+
+#include "boxart.h"
+#include "connection.h"
+
+#include <SDL_image.h>
+#include <errors.h>
+
+#include <openssl/evp.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define BOXART_DIR MOONLIGHT_DIR "/.cache/boxart"
+#define BOXART_MAGIC 0x35363542
+#define BOXART_ENTRIES 128
+// Downscaled art is 16 bit, a large app tile is about 40 KB
+#define BOXART_BYTES (2 * 1024 * 1024)
+#define BOXART_HASH_CHARS (2 * 32)
+// Art that failed to load is asked for again after this long
+#define BOXART_RETRY_MS 30000
+
+enum boxart_state {BOXART_EMPTY, BOXART_PENDING, BOXART_READY, BOXART_MISSING};
+
+typedef struct _BOXART_ENTRY {
+    enum boxart_state state;
+    int app_id;
+    int w, h;
+    SDL_Surface *surface;
+    size_t bytes;
+    uint64_t last_used;
+    Uint32 retry_at;
+    struct _BOXART_ENTRY *next_request;
+} BOXART_ENTRY;
+
+// Header of a downscaled image in the cache, followed by w * h pixels
+typedef struct _BOXART_FILE {
+    uint32_t magic;
+    uint16_t w;
+    uint16_t h;
+} BOXART_FILE;
+
+// Copy of the host, the worker takes its own one with each request
+static SERVER_DATA boxart_server;
+static BOXART_ENTRY entries[BOXART_ENTRIES];
+static size_t cached_bytes;
+static uint64_t use_counter, generation;
+
+// Requests for the worker, entries stay pending until it's done with them
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static BOXART_ENTRY *requests;
+static pthread_t worker;
+static bool worker_running, worker_stop;
+
+static void boxart_hash(const void *data, size_t size, char hex[BOXART_HASH_CHARS + 1]) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    EVP_Digest(data, size, digest, &digest_size, EVP_sha256(), NULL);
+
+    for (unsigned int i = 0; i < digest_size && i < BOXART_HASH_CHARS / 2; i++)
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    hex[BOXART_HASH_CHARS] = '\0';
+}
+
+// The reference file maps host and app to the hash of the art's content
+static void boxart_ref_path(PSERVER_DATA server, int app_id, char *path, size_t size) {
+    char key[256], hash[BOXART_HASH_CHARS + 1];
+    snprintf(key, sizeof(key), "%s/%d", server->serverInfo.address, app_id);
+    boxart_hash(key, strlen(key), hash);
+    snprintf(path, size, "%s/%s.ref", BOXART_DIR, hash);
+}
+
+static void boxart_image_path(const char *hash, int w, int h, char *path, size_t size) {
+    snprintf(path, size, "%s/%s-%dx%d.rgb565", BOXART_DIR, hash, w, h);
+}
+
+static SDL_Surface *boxart_create_surface(int w, int h) {
+    return SDL_CreateRGBSurface(0, w, h, 16, 0xF800, 0x07E0, 0x001F, 0x0000);
+}
+
+static SDL_Surface *boxart_read(const char *path, int w, int h) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    BOXART_FILE header;
+    SDL_Surface *surface = NULL;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == BOXART_MAGIC && header.w <= w && header.h <= h) {
+        surface = boxart_create_surface(header.w, header.h);
+        for (int y = 0; surface && y < header.h; y++) {
+            if (fread((Uint8 *) surface->pixels + y * surface->pitch, 2, header.w, file) != header.w) {
+                SDL_FreeSurface(surface);
+                surface = NULL;
+            }
+        }
+    }
+
+    fclose(file);
+    return surface;
+}
+
+static void boxart_write(const char *path, SDL_Surface *surface) {
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL)
+        return;
+
+    BOXART_FILE header = {BOXART_MAGIC, surface->w, surface->h};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int y = 0; written && y < surface->h; y++)
+        written = fwrite((Uint8 *) surface->pixels + y * surface->pitch, 2, surface->w, file) == (size_t) surface->w;
+
+    // Rename into place, so a torn write never looks like a valid image
+    if (fclose(file) == 0 && written)
+        rename(tmp_path, path);
+    else
+        remove(tmp_path);
+}
+
+// Averages the source pixels covered by each target pixel, box art is
+// shrunk by a factor of five or more where nearest sampling would alias
+static SDL_Surface *boxart_downscale(SDL_Surface *image, int w, int h) {
+    SDL_Surface *source = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (source == NULL)
+        return NULL;
+
+    int dst_w = w, dst_h = h;
+    if (source->w * h > source->h * w)
+        dst_h = SDL_max(1, source->h * w / source->w);
+    else
+        dst_w = SDL_max(1, source->w * h / source->h);
+
+    SDL_Surface *surface = boxart_create_surface(dst_w, dst_h);
+    if (surface == NULL) {
+        SDL_FreeSurface(source);
+        return NULL;
+    }
+
+    for (int y = 0; y < dst_h; y++) {
+        int y0 = y * source->h / dst_h, y1 = SDL_max(y0 + 1, (y + 1) * source->h / dst_h);
+        Uint16 *dst = (Uint16 *) ((Uint8 *) surface->pixels + y * surface->pitch);
+        for (int x = 0; x < dst_w; x++) {
+            int x0 = x * source->w / dst_w, x1 = SDL_max(x0 + 1, (x + 1) * source->w / dst_w);
+            Uint32 r = 0, g = 0, b = 0, count = (x1 - x0) * (y1 - y0);
+            for (int sy = y0; sy < y1; sy++) {
+                const Uint32 *src = (const Uint32 *) ((const Uint8 *) source->pixels + sy * source->pitch);
+                for (int sx = x0; sx < x1; sx++) {
+                    r += (src[sx] >> 16) & 0xFF;
+                    g += (src[sx] >> 8) & 0xFF;
+                    b += src[sx] & 0xFF;
+                }
+            }
+            r /= count;
+            g /= count;
+            b /= count;
+            dst[x] = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+        }
+    }
+
+    SDL_FreeSurface(source);
+    return surface;
+}
+
+// Disk first, the host only when the art isn't cached at this size yet
+static SDL_Surface *boxart_load(PSERVER_DATA server, int app_id, int w, int h) {
+    char ref_path[4096], image_path[4096], hash[BOXART_HASH_CHARS + 1];
+    boxart_ref_path(server, app_id, ref_path, sizeof(ref_path));
+
+    FILE *ref = fopen(ref_path, "r");
+    if (ref) {
+        bool found = fread(hash, 1, BOXART_HASH_CHARS, ref) == BOXART_HASH_CHARS;
+        fclose(ref);
+        if (found) {
+            hash[BOXART_HASH_CHARS] = '\0';
+            boxart_image_path(hash, w, h, image_path, sizeof(image_path));
+            SDL_Surface *surface = boxart_read(image_path, w, h);
+            if (surface)
+                return surface;
+        }
+    }
+
+    char *art = NULL;
+    size_t size = 0;
+    connection_lock();
+    int ret = gs_app_boxart(server, app_id, &art, &size);
+    connection_unlock();
+    if (ret != GS_OK)
+        return NULL;
+
+    SDL_Surface *image = IMG_Load_RW(SDL_RWFromConstMem(art, size), 1);
+    SDL_Surface *surface = image ? boxart_downscale(image, w, h) : NULL;
+    if (image)
+        SDL_FreeSurface(image);
+    if (surface == NULL) {
+        fprintf(stderr, "Could not decode box art of app %d\n", app_id);
+        free(art);
+        return NULL;
+    }
+
+    mkdir(MOONLIGHT_DIR "/.cache", 0755);
+    if (mkdir(BOXART_DIR, 0755) == 0 || errno == EEXIST) {
+        boxart_hash(art, size, hash);
+        boxart_image_path(hash, w, h, image_path, sizeof(image_path));
+        boxart_write(image_path, surface);
+
+        ref = fopen(ref_path, "w");
+        if (ref) {
+            fwrite(hash, 1, BOXART_HASH_CHARS, ref);
+            fclose(ref);
+        }
+    }
+
+    free(art);
+    return surface;
+}
+
+static void *boxart_worker(void *arg) {
+    pthread_mutex_lock(&mutex);
+    while (!worker_stop) {
+        if (requests == NULL) {
+            pthread_cond_wait(&cond, &mutex);
+            continue;
+        }
+
+        BOXART_ENTRY *entry = requests;
+        requests = entry->next_request;
+        int app_id = entry->app_id, w = entry->w, h = entry->h;
+        SERVER_DATA server = boxart_server;
+        pthread_mutex_unlock(&mutex);
+
+        SDL_Surface *surface = boxart_load(&server, app_id, w, h);
+
+        // Pending entries are never evicted, so the entry is still ours
+        pthread_mutex_lock(&mutex);
+        entry->surface = surface;
+        entry->state = surface ? BOXART_READY : BOXART_MISSING;
+        entry->bytes = surface ? (size_t) surface->pitch * surface->h : 0;
+        entry->retry_at = SDL_GetTicks() + BOXART_RETRY_MS;
+        cached_bytes += entry->bytes;
+        __atomic_fetch_add(&generation, 1, __ATOMIC_RELEASE);
+
+        SDL_Event event = {0};
+        event.type = SDL_USEREVENT;
+        event.user.code = SDL_CODE_BOXART;
+        SDL_PushEvent(&event);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return NULL;
+}
+
+void boxart_init(PSERVER_DATA server) {
+    boxart_set_server(server);
+    if (worker_running)
+        return;
+
+    worker_stop = false;
+    worker_running = pthread_create(&worker, NULL, boxart_worker, NULL) == 0;
+    if (!worker_running)
+        fprintf(stderr, "Couldn't start box art worker\n");
+}
+
+static void boxart_evict(BOXART_ENTRY *entry) {
+    cached_bytes -= entry->bytes;
+    if (entry->surface)
+        SDL_FreeSurface(entry->surface);
+
+    memset(entry, 0, sizeof(*entry));
+}
+
+void boxart_destroy(void) {
+    if (worker_running) {
+        pthread_mutex_lock(&mutex);
+        worker_stop = true;
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(worker, NULL);
+        worker_running = false;
+    }
+
+    requests = NULL;
+    for (int i = 0; i < BOXART_ENTRIES; i++)
+        boxart_evict(&entries[i]);
+}
+
+void boxart_set_server(PSERVER_DATA server) {
+    pthread_mutex_lock(&mutex);
+    bool changed = boxart_server.serverInfo.address == NULL || server->serverInfo.address == NULL ||
+        strcmp(boxart_server.serverInfo.address, server->serverInfo.address) != 0;
+    boxart_server = *server;
+
+    // Entries are keyed by app id, which only means something on one host,
+    // art that failed before may load now the host has been reached again
+    for (int i = 0; i < BOXART_ENTRIES; i++) {
+        if (entries[i].state == BOXART_MISSING || (changed && entries[i].state != BOXART_PENDING))
+            boxart_evict(&entries[i]);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+// Least recently used entry the worker isn't busy with, call with the mutex held
+static BOXART_ENTRY *boxart_victim(bool with_image) {
+    BOXART_ENTRY *victim = NULL;
+    for (int i = 0; i < BOXART_ENTRIES; i++) {
+        if (entries[i].state == BOXART_PENDING || (with_image && entries[i].surface == NULL))
+            continue;
+
+        if (victim == NULL || entries[i].last_used < victim->last_used)
+            victim = &entries[i];
+    }
+    return victim;
+}
+
+SDL_Surface *boxart_get(int app_id, int w, int h) {
+    if (!worker_running)
+        return NULL;
+
+    SDL_Surface *surface = NULL;
+    pthread_mutex_lock(&mutex);
+    for (int i = 0; i < BOXART_ENTRIES; i++) {
+        BOXART_ENTRY *entry = &entries[i];
+        if (entry->state != BOXART_EMPTY && entry->app_id == app_id && entry->w == w && entry->h == h) {
+            if (entry->state == BOXART_MISSING && SDL_TICKS_PASSED(SDL_GetTicks(), entry->retry_at)) {
+                boxart_evict(entry);
+                break;
+            }
+
+            entry->last_used = ++use_counter;
+            surface = entry->surface;
+            pthread_mutex_unlock(&mutex);
+            return surface;
+        }
+    }
+
+    // Keep to the memory bound before queueing more work
+    while (cached_bytes > BOXART_BYTES) {
+        BOXART_ENTRY *victim = boxart_victim(true);
+        if (victim == NULL)
+            break;
+        boxart_evict(victim);
+    }
+
+    BOXART_ENTRY *entry = boxart_victim(false);
+    if (entry) {
+        boxart_evict(entry);
+        *entry = (BOXART_ENTRY) {BOXART_PENDING, app_id, w, h, NULL, 0, ++use_counter, 0, NULL};
+
+        // Requests are served in the order the tiles are drawn
+        BOXART_ENTRY **tail = &requests;
+        while (*tail)
+            tail = &(*tail)->next_request;
+        *tail = entry;
+        pthread_cond_signal(&cond);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return surface;
+}
+
+uint64_t boxart_generation(void) {
+    return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+#endif /* HAVE_SDL */
@@ -0,0 +1,46 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_SDL
+
+#include <SDL.h>
+
+#include <client.h>
+
+#include <stdint.h>
+
+// Box art is fetched from the host by a background worker, downscaled
+// once to the tile size in RGB565 and stored in a content addressed cache
+// under BOXART_DIR, so later starts need no network access to show it.
+// Only call from the UI thread, except boxart_generation.
+void boxart_init(PSERVER_DATA server);
+void boxart_destroy(void);
+
+// Takes a copy of the host after a request changed it
+void boxart_set_server(PSERVER_DATA server);
+
+// Box art of an app fitted into w x h, NULL while it's being loaded or
+// when the host has none. The surface stays valid until the next call.
+SDL_Surface *boxart_get(int app_id, int w, int h);
+
+// Changes whenever the worker finished loading box art, a SDL_CODE_BOXART
+// user event is pushed to wake up the menu
+uint64_t boxart_generation(void);
+
+#endif /* HAVE_SDL */
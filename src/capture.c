@@ -0,0 +1,238 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "capture.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_BUFFER_SIZE (1024*1024)
+
+static DECODER_RENDERER_CALLBACKS capture_callbacks;
+static PDECODER_RENDERER_CALLBACKS target;
+static const char* capture_path;
+static FILE* capture_file;
+static char* capture_buffer;
+
+static void capture_stop(void) {
+  if (capture_file) {
+    fclose(capture_file);
+    capture_file = NULL;
+  }
+  free(capture_buffer);
+  capture_buffer = NULL;
+}
+
+static int capture_setup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) {
+  capture_file = fopen(capture_path, "wb");
+  if (capture_file == NULL) {
+    perror("Couldn't open capture file");
+  } else {
+    // Submitting must not wait on the disk for every unit
+    capture_buffer = malloc(CAPTURE_BUFFER_SIZE);
+    if (capture_buffer)
+      setvbuf(capture_file, capture_buffer, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+    CAPTURE_HEADER header = {
+      .magic = CAPTURE_MAGIC,
+      .version = CAPTURE_VERSION,
+      .video_format = videoFormat,
+      .width = width,
+      .height = height,
+      .fps = redrawRate,
+    };
+    if (fwrite(&header, sizeof(header), 1, capture_file) != 1) {
+      fprintf(stderr, "Couldn't write capture file\n");
+      capture_stop();
+    } else
+      printf("Capturing decode units to %s\n", capture_path);
+  }
+
+  int err = target->setup(videoFormat, width, height, redrawRate, context, drFlags);
+  if (err != 0)
+    capture_stop();
+
+  return err;
+}
+
+static void capture_start(void) {
+  if (target->start)
+    target->start();
+}
+
+static void capture_stop_renderer(void) {
+  if (target->stop)
+    target->stop();
+}
+
+static void capture_cleanup(void) {
+  if (target->cleanup)
+    target->cleanup();
+
+  capture_stop();
+}
+
+static int capture_submit_decode_unit(PDECODE_UNIT decodeUnit) {
+  if (capture_file) {
+    CAPTURE_UNIT unit = {
+      .frame_number = decodeUnit->frameNumber,
+      .frame_type = decodeUnit->frameType,
+      .receive_time_ms = decodeUnit->receiveTimeMs,
+      .enqueue_time_ms = decodeUnit->enqueueTimeMs,
+      .presentation_time_ms = decodeUnit->presentationTimeMs,
+      .colorspace = decodeUnit->colorspace,
+      .hdr_active = decodeUnit->hdrActive,
+    };
+    for (PLENTRY entry = decodeUnit->bufferList; entry != NULL; entry = entry->next) {
+      unit.entries++;
+      unit.length += sizeof(CAPTURE_ENTRY) + entry->length;
+    }
+
+    bool written = fwrite(&unit, sizeof(unit), 1, capture_file) == 1;
+    for (PLENTRY entry = decodeUnit->bufferList; written && entry != NULL; entry = entry->next) {
+      CAPTURE_ENTRY header = {entry->bufferType, entry->length};
+      written = fwrite(&header, sizeof(header), 1, capture_file) == 1 &&
+                fwrite(entry->data, 1, entry->length, capture_file) == entry->length;
+    }
+
+    if (!written) {
+      fprintf(stderr, "Couldn't write capture file, capturing stopped\n");
+      capture_stop();
+    }
+  }
+
+  return target->submitDecodeUnit(decodeUnit);
+}
+
+PDECODER_RENDERER_CALLBACKS capture_wrap(PDECODER_RENDERER_CALLBACKS callbacks, const char* path) {
+  target = callbacks;
+  capture_path = path;
+
+  capture_callbacks.setup = capture_setup;
+  capture_callbacks.start = capture_start;
+  capture_callbacks.stop = capture_stop_renderer;
+  capture_callbacks.cleanup = capture_cleanup;
+  capture_callbacks.submitDecodeUnit = capture_submit_decode_unit;
+  capture_callbacks.capabilities = callbacks->capabilities;
+
+  return &capture_callbacks;
+}
+
+int capture_open(PCAPTURE_READER reader, const char* path) {
+  memset(reader, 0, sizeof(*reader));
+  reader->file = fopen(path, "rb");
+  if (reader->file == NULL) {
+    perror("Couldn't open capture file");
+    return -1;
+  }
+
+  if (fread(&reader->header, sizeof(reader->header), 1, reader->file) != 1 ||
+      reader->header.magic != CAPTURE_MAGIC || reader->header.version != CAPTURE_VERSION) {
+    fprintf(stderr, "%s isn't a supported capture file\n", path);
+    capture_close(reader);
+    return -1;
+  }
+
+  return 0;
+}
+
+PDECODE_UNIT capture_read(PCAPTURE_READER reader) {
+  CAPTURE_UNIT unit;
+  if (fread(&unit, sizeof(unit), 1, reader->file) != 1)
+    return NULL;
+
+  if (unit.length > reader->data_size) {
+    char* data = realloc(reader->data, unit.length);
+    if (data == NULL) {
+      fprintf(stderr, "Not enough memory\n");
+      return NULL;
+    }
+    reader->data = data;
+    reader->data_size = unit.length;
+  }
+
+  if (unit.entries > reader->entries_size) {
+    LENTRY* entries = realloc(reader->entries, unit.entries * sizeof(LENTRY));
+    if (entries == NULL) {
+      fprintf(stderr, "Not enough memory\n");
+      return NULL;
+    }
+    reader->entries = entries;
+    reader->entries_size = unit.entries;
+  }
+
+  // Every unit carries data, an empty one only comes from a corrupted file
+  if (unit.entries == 0) {
+    fprintf(stderr, "Capture file is corrupted\n");
+    return NULL;
+  }
+
+  if (fread(reader->data, 1, unit.length, reader->file) != unit.length) {
+    fprintf(stderr, "Capture file is truncated\n");
+    return NULL;
+  }
+
+  PDECODE_UNIT decodeUnit = &reader->unit;
+  memset(decodeUnit, 0, sizeof(*decodeUnit));
+  decodeUnit->frameNumber = unit.frame_number;
+  decodeUnit->frameType = unit.frame_type;
+  decodeUnit->receiveTimeMs = unit.receive_time_ms;
+  decodeUnit->enqueueTimeMs = unit.enqueue_time_ms;
+  decodeUnit->presentationTimeMs = unit.presentation_time_ms;
+  decodeUnit->colorspace = unit.colorspace;
+  decodeUnit->hdrActive = unit.hdr_active;
+
+  // Entries point straight into the payload read from the file
+  size_t offset = 0;
+  PLENTRY* next = &decodeUnit->bufferList;
+  for (int i = 0; i < unit.entries; i++) {
+    CAPTURE_ENTRY header;
+    if (offset + sizeof(header) > unit.length)
+      break;
+    memcpy(&header, reader->data + offset, sizeof(header));
+    offset += sizeof(header);
+    if (header.length > unit.length - offset)
+      break;
+
+    PLENTRY entry = &reader->entries[i];
+    entry->next = NULL;
+    entry->data = reader->data + offset;
+    entry->length = header.length;
+    entry->bufferType = header.buffer_type;
+    offset += header.length;
+    decodeUnit->fullLength += header.length;
+
+    *next = entry;
+    next = &entry->next;
+  }
+
+  if (offset != unit.length) {
+    fprintf(stderr, "Capture file is corrupted\n");
+    return NULL;
+  }
+
+  return decodeUnit;
+}
+
+void capture_close(PCAPTURE_READER reader) {
+  if (reader->file)
+    fclose(reader->file);
+  free(reader->data);
+  free(reader->entries);
+  memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Limelight.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Decode unit capture files, all fields are stored in native byte order.
+// A file starts with a CAPTURE_HEADER followed by one CAPTURE_UNIT per
+// decode unit, each followed by length bytes of CAPTURE_ENTRY headers and
+// their payload.
+#define CAPTURE_MAGIC 0x5544434d // "MCDU"
+#define CAPTURE_VERSION 1
+
+typedef struct _CAPTURE_HEADER {
+  uint32_t magic;
+  uint32_t version;
+  int32_t video_format;
+  int32_t width;
+  int32_t height;
+  int32_t fps;
+} CAPTURE_HEADER, *PCAPTURE_HEADER;
+
+typedef struct _CAPTURE_UNIT {
+  uint32_t length;
+  uint32_t entries;
+  int32_t frame_number;
+  int32_t frame_type;
+  uint64_t receive_time_ms;
+  uint64_t enqueue_time_ms;
+  uint32_t presentation_time_ms;
+  int32_t colorspace;
+  int32_t hdr_active;
+  int32_t reserved;
+} CAPTURE_UNIT, *PCAPTURE_UNIT;
+
+typedef struct _CAPTURE_ENTRY {
+  int32_t buffer_type;
+  uint32_t length;
+} CAPTURE_ENTRY, *PCAPTURE_ENTRY;
+
+typedef struct _CAPTURE_READER {
+  FILE* file;
+  CAPTURE_HEADER header;
+  char* data;
+  size_t data_size;
+  LENTRY* entries;
+  int entries_size;
+  DECODE_UNIT unit;
+} CAPTURE_READER, *PCAPTURE_READER;
+
+// Returns callbacks which write every decode unit to path before passing
+// it on, call after the capabilities of callbacks are final
+PDECODER_RENDERER_CALLBACKS capture_wrap(PDECODER_RENDERER_CALLBACKS callbacks, const char* path);
+
+int capture_open(PCAPTURE_READER reader, const char* path);
+// Returns NULL at the end of the file, the unit stays valid until the next call
+PDECODE_UNIT capture_read(PCAPTURE_READER reader);
+void capture_close(PCAPTURE_READER reader);
@@ -42,6 +42,9 @@
 #define write_config_bool(fd, key, value) fprintf(fd, "%s = %s\n", key, value ? "true":"false")
 
 bool inputAdded = false;
+static bool host_argument;
+// Options given on the command line are for this run only
+static bool command_line_options;
 
 static struct option long_options[] = {
   {"720", no_argument, NULL, 'a'},
@@ -76,6 +79,13 @@ static struct option long_options[] = {
   {"pin", required_argument, NULL, '5'},
   {"port", required_argument, NULL, '6'},
   {"hdr", no_argument, NULL, '7'},
+  {"decodequeue", required_argument, NULL, '8'},
+  {"scaler", required_argument, NULL, '9'},
+  {"native", no_argument, NULL, 'A'},
+  {"fastdecode", no_argument, NULL, 'B'},
+  {"overlay", no_argument, NULL, 'C'},
+  {"capture", required_argument, NULL, 'D'},
+  {"pacing", required_argument, NULL, 'E'},
   {0, 0, 0, 0},
 };
 
@@ -259,12 +269,50 @@ static void parse_argument(int c, char* value, PCONFIGURATION config) {
   case '7':
     config->hdr = true;
     break;
+  case '8':
+    config->decode_queue = atoi(value);
+    break;
+  case '9':
+    if (strcasecmp(value, "sdl") == 0)
+      config->scaler = SCALER_SDL;
+    else if (strcasecmp(value, "nearest") == 0)
+      config->scaler = SCALER_NEAREST;
+    else if (strcasecmp(value, "bilinear") == 0)
+      config->scaler = SCALER_BILINEAR;
+    else
+      fprintf(stderr, "Unknown scaler %s\n", value);
+    break;
+  case 'A':
+    config->native_panel = true;
+    break;
+  case 'B':
+    config->fast_decode = true;
+    break;
+  case 'C':
+    config->overlay = true;
+    break;
+  case 'D':
+    config->capture = value;
+    break;
+  case 'E':
+    if (strcasecmp(value, "lowest") == 0)
+      config->pacing = PACING_LOWEST_LATENCY;
+    else if (strcasecmp(value, "balanced") == 0)
+      config->pacing = PACING_BALANCED;
+    else if (strcasecmp(value, "smooth") == 0)
+      config->pacing = PACING_SMOOTH;
+    else
+      fprintf(stderr, "Unknown pacing %s\n", value);
+    break;
   case 1:
     if (config->action == NULL)
       config->action = value;
-    else if (config->address == NULL)
-      config->address = value;
-    else {
+    else if (!host_argument) {
+      // Replaces the address of the configuration file, it's freed on exit
+      free(config->address);
+      config->address = strdup(value);
+      host_argument = true;
+    } else {
       perror("Too many options");
       exit(-1);
     }
@@ -330,6 +378,20 @@ void config_save(char* filename, PCONFIGURATION config) {
     write_config_bool(fd, "viewonly", config->viewonly);
   if (config->rotate != 0)
     write_config_int(fd, "rotate", config->rotate);
+  if (config->decode_queue != 0)
+    write_config_int(fd, "decodequeue", config->decode_queue);
+  if (config->scaler != SCALER_SDL)
+    write_config_string(fd, "scaler", config->scaler == SCALER_NEAREST ? "nearest" : "bilinear");
+  if (config->pacing != PACING_BALANCED)
+    write_config_string(fd, "pacing", config->pacing == PACING_LOWEST_LATENCY ? "lowest" : "smooth");
+  if (config->native_panel)
+    write_config_bool(fd, "native", config->native_panel);
+  if (config->fast_decode)
+    write_config_bool(fd, "fastdecode", config->fast_decode);
+  if (config->overlay)
+    write_config_bool(fd, "overlay", config->overlay);
+  if (config->capture)
+    write_config_string(fd, "capture", config->capture);
 
   if (config->address)
     write_config_string(fd, "address", config->address); 
@@ -384,6 +446,13 @@ void config_default() {
   config.hdr = false;
   config.pin = 0;
   config.port = 47989;
+  config.decode_queue = 0;
+  config.scaler = SCALER_SDL;
+  config.pacing = PACING_BALANCED;
+  config.native_panel = false;
+  config.fast_decode = false;
+  config.overlay = false;
+  config.capture = NULL;
 
   config.inputsCount = 0;
   config.mapping = get_path("gamecontrollerdb.txt", getenv("XDG_DATA_DIRS"));
@@ -404,27 +473,52 @@ void config_default() {
     else
       sprintf(config.key_dir, "%s" DEFAULT_CACHE_DIR MOONLIGHT_PATH, pw->pw_dir);
   }
-  
-    if (config.stream.bitrate == -1) {
-    // This table prefers 16:10 resolutions because they are
-    // only slightly more pixels than the 16:9 equivalents, so
-    // we don't want to bump those 16:10 resolutions up to the
-    // next 16:9 slot.
-
-    if (config.stream.width * config.stream.height <= 640 * 360) {
-      config.stream.bitrate = (int)(1000 * (config.stream.fps / 30.0));
-    } else if (config.stream.width * config.stream.height <= 854 * 480) {
-      config.stream.bitrate = (int)(1500 * (config.stream.fps / 30.0));
-    } else if (config.stream.width * config.stream.height <= 1366 * 768) {
-      // This covers 1280x720 and 1280x800 too
-      config.stream.bitrate = (int)(5000 * (config.stream.fps / 30.0));
-    } else if (config.stream.width * config.stream.height <= 1920 * 1200) {
-      config.stream.bitrate = (int)(10000 * (config.stream.fps / 30.0));
-    } else if (config.stream.width * config.stream.height <= 2560 * 1600) {
-      config.stream.bitrate = (int)(20000 * (config.stream.fps / 30.0));
-    } else /* if (config.stream.width * config.stream.height <= 3840 * 2160) */ {
-      config.stream.bitrate = (int)(40000 * (config.stream.fps / 30.0));
-    }
+
+  // A bitrate of -1 is resolved with config_default_bitrate() when the
+  // stream starts, once the final resolution is known
+}
+
+// Options on the command line override the configuration file, which
+// config_default() already parsed
+void config_parse(int argc, char* argv[], PCONFIGURATION config) {
+  command_line_options = argc > 1;
+
+  int option_index = 0;
+  int c;
+  while ((c = getopt_long_only(argc, argv, "-", long_options, &option_index)) != -1) {
+    if (c == '?')
+      exit(EXIT_FAILURE);
+
+    parse_argument(c, optarg, config);
   }
 
+  if (config->config_file != NULL)
+    config_save(config->config_file, config);
+}
+
+void config_save_settings(PCONFIGURATION config) {
+  if (!command_line_options)
+    config_save(MOONLIGHT_CONF, config);
+}
+
+int config_default_bitrate(int width, int height, int fps) {
+  // This table prefers 16:10 resolutions because they are
+  // only slightly more pixels than the 16:9 equivalents, so
+  // we don't want to bump those 16:10 resolutions up to the
+  // next 16:9 slot.
+
+  if (width * height <= 640 * 360) {
+    return (int)(1000 * (fps / 30.0));
+  } else if (width * height <= 854 * 480) {
+    return (int)(1500 * (fps / 30.0));
+  } else if (width * height <= 1366 * 768) {
+    // This covers 1280x720 and 1280x800 too
+    return (int)(5000 * (fps / 30.0));
+  } else if (width * height <= 1920 * 1200) {
+    return (int)(10000 * (fps / 30.0));
+  } else if (width * height <= 2560 * 1600) {
+    return (int)(20000 * (fps / 30.0));
+  } else /* if (width * height <= 3840 * 2160) */ {
+    return (int)(40000 * (fps / 30.0));
+  }
 }
@@ -26,6 +26,9 @@
 
 #define MAX_INPUTS 6
 
+enum scalers {SCALER_SDL, SCALER_NEAREST, SCALER_BILINEAR};
+enum pacing {PACING_LOWEST_LATENCY, PACING_BALANCED, PACING_SMOOTH};
+
 typedef struct _CONFIGURATION {
   STREAM_CONFIGURATION stream;
   int debug_level;
@@ -51,6 +54,13 @@ typedef struct _CONFIGURATION {
   bool hdr;
   int pin;
   unsigned short port;
+  int decode_queue;
+  enum scalers scaler;
+  enum pacing pacing;
+  bool native_panel;
+  bool fast_decode;
+  bool overlay;
+  char* capture;
 } CONFIGURATION, *PCONFIGURATION;
 
 #define MOONLIGHT_CONF "/mnt/SDCARD/App/moonlight/config/moonlight.conf"
@@ -62,5 +72,8 @@ void config_default();
 void config_save(char* filename, PCONFIGURATION config);
 bool config_file_parse(char* filename, PCONFIGURATION config);
 void config_parse(int argc, char* argv[], PCONFIGURATION config);
+// Writes MOONLIGHT_CONF, unless options were given on the command line
+void config_save_settings(PCONFIGURATION config);
+int config_default_bitrate(int width, int height, int fps);
 
 #endif
\ No newline at end of file
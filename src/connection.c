@@ -18,6 +18,12 @@
  */
 
 #include "connection.h"
+#include "latency.h"
+#include "capture.h"
+#include "app_catalog.h"
+#include "boxart.h"
+#include "startup.h"
+#include "task.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -30,83 +36,140 @@
 SERVER_DATA server;
 CONFIGURATION config;
 
+// Arguments of a gamestream task, owned by the task
 typedef struct {
+    // The task's own copy of the host, published to the global one on the
+    // UI thread once it's done
+    SERVER_DATA host;
     PSERVER_DATA server;
     CONFIGURATION *config;
     SDLContext *ctx;
+    int connect_result;
+    bool trace;
+    char pin[5];
+    // Session a launch starts, filled in on the UI thread
+    STREAM_CONFIGURATION stream;
+    enum platform system;
+    int gamepad_mask;
 } ConnectRemoteArgs;
 
 pthread_t main_thread_id = 0;
 bool connection_debug;
+int connection_status;
+// Why the host ended the last session, 0 when it ended gracefully
+static int connection_error;
 ConnListenerRumble rumble_handler = NULL;
 ConnListenerRumbleTriggers rumble_triggers_handler = NULL;
 ConnListenerSetMotionEventState set_motion_event_state_handler = NULL;
 ConnListenerSetControllerLED set_controller_led_handler = NULL;
 
+// libgamestream shares one HTTP client between all requests
+static pthread_mutex_t gs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Gamestream task started from the menu, one at a time. A cancelled task
+// stays current until its done callback ran. UI thread only.
+static PTASK current_task;
+static bool current_cancelled;
+
     // pair_check(&server);
     // applist(&server);
     
-int applist(PSERVER_DATA server, char ***appNames) {
-    PAPP_LIST list = NULL;
-    int count = 0;
+void connection_lock(void) {
+    pthread_mutex_lock(&gs_mutex);
+}
 
-    if (gs_applist(server, &list) != GS_OK) {
-        fprintf(stderr, "Can't get app list\n");
-        return 0;
-    }
+void connection_unlock(void) {
+    pthread_mutex_unlock(&gs_mutex);
+}
 
-    PAPP_LIST originalList = list;
+// Starting a stream needs the id now, from the menu the launch task has
+// already fetched the list so this doesn't wait
+int get_app_id(PSERVER_DATA server, const char *name) {
+  const APP_CATALOG* apps = app_catalog_acquire_sync(server);
+  if (apps == NULL)
+    return -1;
 
-    while (list != NULL) {
-        count++;
-        list = list->next;
+  int id = -1;
+  for (int i = 0; i < apps->count; i++) {
+    if (strcmp(apps->names[i], name) == 0) {
+      id = apps->ids[i];
+      break;
     }
+  }
 
-    *appNames = malloc(count * sizeof(char *));
-    if (*appNames == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        return 0;
-    }
+  app_catalog_release(apps);
+  return id;
+}
 
-    list = originalList;
-    for (int i = 0; list != NULL; i++) {
-        (*appNames)[i] = strdup(list->name);
-        if ((*appNames)[i] == NULL) {
-            fprintf(stderr, "Memory allocation failed\n");
-            return 0;
-        }
-        list = list->next;
-    }
+static void native_mode_size(int width, int height, int panel_width, int panel_height, int* displayed_width, int* displayed_height) {
+  if (width * panel_height > height * panel_width) {
+    *displayed_width = panel_width;
+    *displayed_height = panel_width * height / width;
+  } else {
+    *displayed_width = panel_height * width / height;
+    *displayed_height = panel_height;
+  }
+}
+
+static bool native_mode_better(unsigned int width, unsigned int height, unsigned int refresh, PDISPLAY_MODE best, int panel_width, int panel_height, int fps) {
+  if (best == NULL)
+    return true;
 
-    return count;
+  // A mode covers the panel when it doesn't have to be upscaled after letterboxing
+  int displayed_width, displayed_height;
+  native_mode_size(width, height, panel_width, panel_height, &displayed_width, &displayed_height);
+  bool covers = width >= displayed_width && height >= displayed_height;
+  native_mode_size(best->width, best->height, panel_width, panel_height, &displayed_width, &displayed_height);
+  bool best_covers = best->width >= displayed_width && best->height >= displayed_height;
+
+  if (covers != best_covers)
+    return covers;
+
+  // Among covering modes the cheapest to decode wins, otherwise the closest to covering
+  unsigned int pixels = width * height, best_pixels = best->width * best->height;
+  if (pixels != best_pixels)
+    return covers ? pixels < best_pixels : pixels > best_pixels;
+
+  return abs((int) refresh - fps) < abs((int) best->refresh - fps);
 }
 
-int get_app_id(PSERVER_DATA server, const char *name) {
-  PAPP_LIST list = NULL;
-  if (gs_applist(server, &list) != GS_OK) {
-    fprintf(stderr, "Can't get app list\n");
-    return -1;
+static void select_native_mode(PSERVER_DATA server, PSTREAM_CONFIGURATION stream, int panel_width, int panel_height) {
+  DISPLAY_MODE best = {0};
+  PDISPLAY_MODE best_mode = NULL;
+
+  for (PDISPLAY_MODE mode = server->modes; mode != NULL; mode = mode->next) {
+    if (mode->width == 0 || mode->height == 0)
+      continue;
+
+    if (native_mode_better(mode->width, mode->height, mode->refresh, best_mode, panel_width, panel_height, stream->fps)) {
+      best = *mode;
+      best_mode = &best;
+    }
   }
 
-  while (list != NULL) {
-    if (strcmp(list->name, name) == 0)
-      return list->id;
+  // When modes outside the list are allowed, the panel resolution itself is the best match
+  if (server->unsupported && native_mode_better(panel_width, panel_height, stream->fps, best_mode, panel_width, panel_height, stream->fps)) {
+    best.width = panel_width;
+    best.height = panel_height;
+    best.refresh = stream->fps;
+    best_mode = &best;
+  }
 
-    list = list->next;
+  if (best_mode == NULL) {
+    fprintf(stderr, "Server didn't report any display modes, keeping %dx%d\n", stream->width, stream->height);
+    return;
   }
-  return -1;
+
+  stream->width = best.width;
+  stream->height = best.height;
+  stream->fps = best.refresh;
+  printf("Native panel mode: streaming %dx%d at %d fps\n", stream->width, stream->height, stream->fps);
 }
 
-void stream(PSERVER_DATA server, PCONFIGURATION config, enum platform system) {
-  int appId = get_app_id(server, config->app);
-  if (appId<0) {
-    fprintf(stderr, "Can't find app %s\n", config->app);
-    
-    exit(-1);
-  }
-  
-  fprintf(stderr, "User selected app: %d, and %s\n", appId, config->app);
+// A positive result, libgamestream only returns GS_* codes of 0 and below
+#define STREAM_APP_MISSING 1
 
+static int stream_gamepad_mask(void) {
   int gamepads = 0;
   gamepads += evdev_gamepads;
   #ifdef HAVE_SDL
@@ -116,22 +179,51 @@ void stream(PSERVER_DATA server, PCONFIGURATION config, enum platform system) {
   for (int i = 0; i < gamepads; i++)
     gamepad_mask = (gamepad_mask << 1) + 1;
 
-  int ret = gs_start_app(server, &config->stream, appId, config->sops, config->localaudio, gamepad_mask);
-  if (ret < 0) {
-    if (ret == GS_NOT_SUPPORTED_4K)
-      fprintf(stderr, "Server doesn't support 4K\n");
-    else if (ret == GS_NOT_SUPPORTED_MODE)
-      fprintf(stderr, "Server doesn't support %dx%d (%d fps) or remove --nounsupported option\n", config->stream.width, config->stream.height, config->stream.fps);
-    else if (ret == GS_NOT_SUPPORTED_SOPS_RESOLUTION)
-      fprintf(stderr, "Optimal Playable Settings isn't supported for the resolution %dx%d, use supported resolution or add --nosops option\n", config->stream.width, config->stream.height);
-    else if (ret == GS_ERROR)
-      fprintf(stderr, "Gamestream error: %s\n", gs_error);
-    else
-      fprintf(stderr, "Errorcode starting app: %d\n", ret);
-    
-    exit(-1);
-  }
+  return gamepad_mask;
+}
+
+// Resolves config->app and asks the host to start it. This waits for the
+// host, so the menu runs it in the launch task. stream_config holds the
+// settings picked for this session only, they must not end up in the
+// configuration file saved on exit.
+static int stream_start_app(PSERVER_DATA server, PCONFIGURATION config, PSTREAM_CONFIGURATION stream_config, int gamepad_mask) {
+  int appId = get_app_id(server, config->app);
+  if (appId < 0)
+    return STREAM_APP_MISSING;
+
+  fprintf(stderr, "User selected app: %d, and %s\n", appId, config->app);
+
+  if (config->native_panel)
+    select_native_mode(server, stream_config, PANEL_WIDTH, PANEL_HEIGHT);
+
+  // Scale the default bitrate with the resolution that is actually streamed
+  if (stream_config->bitrate == -1)
+    stream_config->bitrate = config_default_bitrate(stream_config->width, stream_config->height, stream_config->fps);
+
+  connection_lock();
+  int ret = gs_start_app(server, stream_config, appId, config->sops, config->localaudio, gamepad_mask);
+  connection_unlock();
 
+  return ret;
+}
+
+static void stream_error(int ret, PCONFIGURATION config, PSTREAM_CONFIGURATION stream_config, char *message, size_t size) {
+  if (ret == STREAM_APP_MISSING)
+    snprintf(message, size, "Can't find app %s", config->app);
+  else if (ret == GS_NOT_SUPPORTED_4K)
+    snprintf(message, size, "Server doesn't support 4K");
+  else if (ret == GS_NOT_SUPPORTED_MODE)
+    snprintf(message, size, "Server doesn't support %dx%d (%d fps) or remove --nounsupported option", stream_config->width, stream_config->height, stream_config->fps);
+  else if (ret == GS_NOT_SUPPORTED_SOPS_RESOLUTION)
+    snprintf(message, size, "Optimal Playable Settings isn't supported for the resolution %dx%d, use supported resolution or add --nosops option", stream_config->width, stream_config->height);
+  else if (ret == GS_ERROR)
+    snprintf(message, size, "Gamestream error: %s", gs_error);
+  else
+    snprintf(message, size, "Errorcode starting app: %d", ret);
+}
+
+// Connects to the app started by stream_start_app and returns once the session ended
+void stream(PSERVER_DATA server, PCONFIGURATION config, PSTREAM_CONFIGURATION stream_config, enum platform system) {
   int drFlags = 0;
   if (config->fullscreen)
     drFlags |= DISPLAY_FULLSCREEN;
@@ -153,21 +245,29 @@ void stream(PSERVER_DATA server, PCONFIGURATION config, enum platform system) {
   }
 
   if (config->debug_level > 0) {
-    printf("Stream %d x %d, %d fps, %d kbps\n", config->stream.width, config->stream.height, config->stream.fps, config->stream.bitrate);
+    printf("Stream %d x %d, %d fps, %d kbps\n", stream_config->width, stream_config->height, stream_config->fps, stream_config->bitrate);
     connection_debug = true;
   }
 
   if (IS_EMBEDDED(system))
     loop_init();
 
+  latency_init();
+  connection_status = CONN_STATUS_OKAY;
   platform_start(system);
-  LiStartConnection(&server->serverInfo, &config->stream, &connection_callbacks, platform_get_video(system), platform_get_audio(system, config->audio_device), NULL, drFlags, config->audio_device, 0);
+  PDECODER_RENDERER_CALLBACKS video_callbacks = platform_get_video(system);
+  if (config->capture)
+    video_callbacks = capture_wrap(video_callbacks, config->capture);
+
+  LiStartConnection(&server->serverInfo, stream_config, &connection_callbacks, video_callbacks, platform_get_audio(system, config->audio_device), NULL, drFlags, config->audio_device, 0);
 
+  // The fake platform runs headless, without any input devices
+  bool input = !config->viewonly && system != FAKE;
   if (IS_EMBEDDED(system)) {
-    if (!config->viewonly)
+    if (input)
       evdev_start();
     loop_main();
-    if (!config->viewonly)
+    if (input)
       evdev_stop();
   }
   #ifdef HAVE_SDL
@@ -176,15 +276,25 @@ void stream(PSERVER_DATA server, PCONFIGURATION config, enum platform system) {
   #endif
 
   LiStopConnection();
+  latency_dump();
 
   if (config->quitappafter) {
     if (config->debug_level > 0)
       printf("Sending app quit request ...\n");
+    connection_lock();
     gs_quit_app(server);
+    connection_unlock();
   }
 
 
   platform_stop(system);
+
+  // Only now that the session is torn down and its stats are printed,
+  // cleaning up SDL ends the process
+  #ifdef HAVE_SDL
+  if (system == SDL)
+    cleanupSDLContext(&ctx);
+  #endif
 }
 
 int pair_check(PSERVER_DATA server) {
@@ -196,18 +306,14 @@ int pair_check(PSERVER_DATA server) {
   return 0;
 }
 
-void* connectRemoteWrapper(void* args) {
-    ConnectRemoteArgs* unpacked_args = (ConnectRemoteArgs*) args;
-    connectRemote(unpacked_args->server, unpacked_args->config, unpacked_args->ctx);
-    free(unpacked_args);
-    return NULL;
-}
 
 void quitRemote(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx) {  
     sdl_banner(ctx, "Sending quit command to %s...", "orange", config->address);        
     printf("Sending quit command to %s...\n", config->address);
 
+    connection_lock();
     int ret = gs_quit_app(server);
+    connection_unlock();
 
     if (ret == GS_OK) {
         sdl_banner(ctx, "Quit command sent to server: %s", "green", config->address);
@@ -229,14 +335,19 @@ void quitRemote(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx) {
     }
 }
 
-void connectRemote(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx) {  
-    sdl_banner(ctx, "Connecting to %s...\n", "orange", config->address);        
+// Loads the client certificate, generating it on first start, and queries
+// the host without touching the UI
+static int connect_host(PSERVER_DATA server, CONFIGURATION *config) {
     printf("Connecting to %s...\n", config->address);
 
-    int ret;
-    
-    ret = gs_init(server, config->address, config->port, config->key_dir, config->debug_level, config->unsupported);
+    connection_lock();
+    int ret = gs_init(server, config->address, config->port, config->key_dir, config->debug_level, config->unsupported);
+    connection_unlock();
 
+    return ret;
+}
+
+static void connect_report(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx, int ret) {
     if (ret == GS_OUT_OF_MEMORY) {
         printf("Not enough memory\n");
         sdl_banner(ctx, "Not enough memory", "red");
@@ -262,99 +373,239 @@ void connectRemote(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx)
     }
 }
 
-int launchConnectRemoteThread(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx) {
-    pthread_t connect_thread;
-    ConnectRemoteArgs* args = malloc(sizeof(ConnectRemoteArgs));
-    if (args == NULL) {
-        printf("Pthread memory alloc. error");
-        return -1;
+static void connection_progress(const char *message, void *data) {
+    ConnectRemoteArgs *args = data;
+    sdl_banner(args->ctx, "%s", "orange", message);
+}
+
+// Connects first in every task, later steps are skipped when that failed
+static int connection_run_connect(PTASK task, ConnectRemoteArgs *args) {
+    task_progress(task, "Connecting to %s...", args->config->address);
+
+    int phase = args->trace ? startup_begin("gs_init") : -1;
+    args->connect_result = connect_host(args->server, args->config);
+    startup_end(phase);
+
+    return args->connect_result;
+}
+
+// Makes what a task learned about the host visible to the menu, the app
+// list and box art. UI thread only, so they never see a half written host.
+static void connection_publish(PSERVER_DATA host) {
+    bool changed = server.serverInfo.address == NULL || host->serverInfo.address == NULL ||
+        strcmp(server.serverInfo.address, host->serverInfo.address) != 0 || server.paired != host->paired;
+
+    server = *host;
+    // The host may have changed, so may its apps
+    if (changed)
+        app_catalog_invalidate();
+    boxart_set_server(&server);
+}
+
+// Returns the args of a finished task to report, or NULL when it was
+// cancelled or failed to connect, which are reported here
+static ConnectRemoteArgs *connection_finish(void *data, bool cancelled) {
+    ConnectRemoteArgs *args = data;
+    current_task = NULL;
+    current_cancelled = false;
+
+    if (!cancelled && args->connect_result == GS_OK)
+        connection_publish(args->server);
+
+    if (!cancelled && args->connect_result != GS_OK)
+        connect_report(args->server, args->config, args->ctx, args->connect_result);
+
+    if (cancelled || args->connect_result != GS_OK) {
+        free(args);
+        return NULL;
     }
 
-    args->server = server;
-    args->config = config;
-    args->ctx = ctx;
+    return args;
+}
+
+bool connection_busy(SDLContext *ctx) {
+    if (current_task && current_cancelled)
+        sdl_banner(ctx, "Busy, waiting for the cancelled request", "red");
+    else if (current_task)
+        sdl_banner(ctx, "Busy, press Escape to cancel", "red");
 
-    int ret = pthread_create(&connect_thread, NULL, connectRemoteWrapper, (void*)args);
-    if (ret != 0) {
-        printf("Pthread creation error");
-        return -2;
+    return current_task != NULL;
+}
+
+static bool connection_submit(SDLContext *ctx, const char *name, TaskRun run, TaskDone done, ConnectRemoteArgs *args) {
+    if (connection_busy(ctx)) {
+        free(args);
+        return false;
     }
 
-    pthread_detach(connect_thread);
+    current_task = task_submit(name, run, connection_progress, done, args);
+    if (current_task == NULL) {
+        sdl_banner(ctx, "Not enough memory", "red");
+        free(args);
+        return false;
+    }
 
-    return 0;
+    return true;
 }
 
-void pairClient(SDLContext *ctx) {
-    char pin[5];
-    
-    connectRemote(&server, &config, ctx);
-    
-    if (config.pin > 0 && config.pin <= 9999) {
-      sprintf(pin, "%04d", config.pin);
-    } else {
-      sprintf(pin, "%d%d%d%d", (unsigned)random() % 10, (unsigned)random() % 10, (unsigned)random() % 10, (unsigned)random() % 10);
+static ConnectRemoteArgs *connection_args(SDLContext *ctx) {
+    ConnectRemoteArgs *args = calloc(1, sizeof(ConnectRemoteArgs));
+    if (args) {
+        args->host = server;
+        args->server = &args->host;
+        args->config = &config;
+        args->ctx = ctx;
     }
-    printf("Please enter the following PIN on the target PC: %s\n", pin);
-    
-    sdl_banner(ctx, "Enter the pin on the remote! %s", "orange", pin);
+    return args;
+}
+
+// The request keeps running until the host answers, so no new task starts
+// before its done callback ran
+bool connection_cancel(SDLContext *ctx) {
+    if (current_task == NULL || current_cancelled)
+        return false;
+
+    task_cancel(current_task);
+    current_cancelled = true;
+    sdl_banner(ctx, "Cancelled", "orange");
+    return true;
+}
+
+static int connect_run(PTASK task, void *data) {
+    return connection_run_connect(task, data);
+}
 
+static void connect_done(int result, bool cancelled, void *data) {
+    ConnectRemoteArgs *args = connection_finish(data, cancelled);
+    if (args) {
+        connect_report(args->server, args->config, args->ctx, result);
+        free(args);
+    }
+}
+
+void connectRemote(SDLContext *ctx, bool trace) {
+    ConnectRemoteArgs *args = connection_args(ctx);
+    if (args == NULL)
+        return;
+
+    args->trace = trace;
+    connection_submit(ctx, "connect", connect_run, connect_done, args);
+}
+
+static int pair_run(PTASK task, void *data) {
+    ConnectRemoteArgs *args = data;
+    if (connection_run_connect(task, args) != GS_OK || task_cancelled(task))
+        return GS_FAILED;
+
+    printf("Please enter the following PIN on the target PC: %s\n", args->pin);
     fflush(stdout);
-    if (gs_pair(&server, &pin[0]) != GS_OK) {
+    task_progress(task, "Enter the pin on the remote! %s", args->pin);
+
+    connection_lock();
+    int ret = gs_pair(args->server, args->pin);
+    connection_unlock();
+
+    return ret;
+}
+
+static void pair_done(int result, bool cancelled, void *data) {
+    ConnectRemoteArgs *args = connection_finish(data, cancelled);
+    if (args == NULL)
+        return;
+
+    if (result != GS_OK) {
       fprintf(stderr, "Failed to pair to server: %s\n", gs_error);
-      sdl_banner(ctx, "Failed: %s", "red", gs_error);
-      // server.paired = 0;
+      sdl_banner(args->ctx, "Failed: %s", "red", gs_error);
     } else {
       printf("Successfully paired\n");
-      sdl_banner(ctx, "Successfully paired!", "green");
-      // server.paired = 1;
-      ctx->state.redrawAll = 1;
-      ctx->state.inIPInput = 0;
+      sdl_banner(args->ctx, "Successfully paired!", "green");
+      args->ctx->state.redrawAll = 1;
+      args->ctx->state.inIPInput = 0;
     }
+    free(args);
 }
 
-void unPairClient(SDLContext *ctx) {
-    
-    int pair_eval = pair_check(&server);
-    if (pair_eval == 1) {
-        sdl_banner(ctx, "You must pair first!", "red");
+void pairClient(SDLContext *ctx) {
+    ConnectRemoteArgs *args = connection_args(ctx);
+    if (args == NULL)
         return;
-    }
-    char pairdone_path[128], cache_path[128];
-    connectRemote(&server, &config, NULL);
 
-    
-    if (gs_unpair(&server) != GS_OK) {
-        fprintf(stderr, "Failed to unpair to server: %s\n", gs_error);
-        sdl_banner(ctx, "Failed: *s", "red", gs_error);
+    if (config.pin > 0 && config.pin <= 9999) {
+      sprintf(args->pin, "%04d", config.pin);
     } else {
-        // server.paired = 0;
+      sprintf(args->pin, "%d%d%d%d", (unsigned)random() % 10, (unsigned)random() % 10, (unsigned)random() % 10, (unsigned)random() % 10);
+    }
+
+    connection_submit(ctx, "pair", pair_run, pair_done, args);
+}
+
+static int unpair_run(PTASK task, void *data) {
+    ConnectRemoteArgs *args = data;
+    if (connection_run_connect(task, args) != GS_OK || task_cancelled(task))
+        return GS_FAILED;
+
+    task_progress(task, "Please wait.... Unpairing");
+    connection_lock();
+    int ret = gs_unpair(args->server);
+    connection_unlock();
+    // Publishing the host then drops the app list
+    if (ret == GS_OK)
+        args->server->paired = false;
+
+    if (ret == GS_OK) {
+        char pairdone_path[128], cache_path[128];
         snprintf(pairdone_path, sizeof(pairdone_path), "%s/config/pairdone", MOONLIGHT_DIR);
         snprintf(cache_path, sizeof(cache_path), "%s/.cache", MOONLIGHT_DIR);
 
         is_file_exist_and_remove(pairdone_path);
         is_dir_exist_and_remove(cache_path);
         is_file_exist_and_remove("/tmp/launch");
-        
+    }
+
+    return ret;
+}
+
+static void unpair_done(int result, bool cancelled, void *data) {
+    ConnectRemoteArgs *args = connection_finish(data, cancelled);
+    if (args == NULL)
+        return;
+
+    if (result != GS_OK) {
+        fprintf(stderr, "Failed to unpair to server: %s\n", gs_error);
+        sdl_banner(args->ctx, "Failed: %s", "red", gs_error);
+    } else {
         printf("Successfully unpaired\n");
-        sdl_banner(ctx, "Successfully unpaired!", "green");
+        sdl_banner(args->ctx, "Successfully unpaired!", "green");
     }
+    free(args);
 }
 
-void handleStreaming(PSERVER_DATA server, CONFIGURATION *config) {
-    pair_check(server);
+void unPairClient(SDLContext *ctx) {
+    
+    int pair_eval = pair_check(&server);
+    if (pair_eval == 1) {
+        sdl_banner(ctx, "You must pair first!", "red");
+        return;
+    }
+
+    ConnectRemoteArgs *args = connection_args(ctx);
+    if (args)
+        connection_submit(ctx, "unpair", unpair_run, unpair_done, args);
+}
+
+// Picks the codecs of the platform and checks the options against it,
+// 0 with the reason in message when it can't stream
+static enum platform stream_platform(PCONFIGURATION config, char *message, size_t size) {
     enum platform system = platform_check(config->platform);
     if (config->debug_level > 0)
       printf("Platform %s\n", platform_name(system));
 
     if (system == 0) {
-      fprintf(stderr, "Platform '%s' not found\n", config->platform);
-      
-      exit(-1);
+      snprintf(message, size, "Platform '%s' not found", config->platform);
+      return 0;
     } else if (system == SDL && config->audio_device != NULL) {
-      fprintf(stderr, "You can't select a audio device for SDL\n");
-      
-      exit(-1);
+      snprintf(message, size, "You can't select a audio device for SDL");
+      return 0;
     }
 
     config->stream.supportedVideoFormats = VIDEO_FORMAT_H264;
@@ -370,23 +621,41 @@ void handleStreaming(PSERVER_DATA server, CONFIGURATION *config) {
     }
 
     if (config->hdr && !(config->stream.supportedVideoFormats & VIDEO_FORMAT_MASK_10BIT)) {
-      fprintf(stderr, "HDR streaming requires HEVC or AV1 codec\n");
-      
-      exit(-1);
+      snprintf(message, size, "HDR streaming requires HEVC or AV1 codec");
+      return 0;
+    }
+
+    if (!config->viewonly && system != FAKE) {
+      if (IS_EMBEDDED(system) && config->mapping == NULL && getenv("SDL_GAMECONTROLLERCONFIG") == NULL) {
+        snprintf(message, size, "Please specify mapping file as default mapping could not be found.");
+        return 0;
+      }
+      #ifdef HAVE_SDL
+      else if (system == SDL && config->inputsCount > 0) {
+        snprintf(message, size, "You can't select input devices as SDL will automatically use all available controllers");
+        return 0;
+      }
+      #endif
     }
 
-    if (config->viewonly) {
+    return system;
+}
+
+// Opens the input devices, they stay open when a launch fails so a later
+// one doesn't add them twice. Gamepads have to be counted before the app
+// is started.
+static void stream_inputs(PCONFIGURATION config, enum platform system) {
+    static bool inputs_ready;
+    if (inputs_ready)
+      return;
+
+    inputs_ready = true;
+    if (config->viewonly || system == FAKE) {
       if (config->debug_level > 0)
         printf("View-only mode enabled, no input will be sent to the host computer\n");
     } else {
       if (IS_EMBEDDED(system)) {
         char* mapping_env = getenv("SDL_GAMECONTROLLERCONFIG");
-        if (config->mapping == NULL && mapping_env == NULL) {
-          fprintf(stderr, "Please specify mapping file as default mapping could not be found.\n");
-          cleanupSDLContext(&ctx);
-          exit(-1);
-        }
-
         struct mapping* mappings = NULL;
         if (config->mapping != NULL)
           mappings = mapping_load(config->mapping, config->debug_level > 0);
@@ -413,12 +682,6 @@ void handleStreaming(PSERVER_DATA server, CONFIGURATION *config) {
       }
       #ifdef HAVE_SDL
       else if (system == SDL) {
-        if (config->inputsCount > 0) {
-          fprintf(stderr, "You can't select input devices as SDL will automatically use all available controllers\n");
-          
-          exit(-1);
-        }
-
         sdlinput_init(config->mapping);
         rumble_handler = sdlinput_rumble;
         rumble_triggers_handler = sdlinput_rumble_triggers;
@@ -427,11 +690,114 @@ void handleStreaming(PSERVER_DATA server, CONFIGURATION *config) {
       }
       #endif
     }
-    
-    stream(server, config, system);
+}
+
+// Resolving the app and starting it on the host happen here, the done
+// callback only starts the session
+static int launch_run(PTASK task, void *data) {
+    ConnectRemoteArgs *args = data;
+    if (connection_run_connect(task, args) != GS_OK || task_cancelled(task))
+        return GS_FAILED;
+
+    task_progress(task, "Starting %s...", args->config->app);
+    return stream_start_app(args->server, args->config, &args->stream, args->gamepad_mask);
+}
+
+static void launch_done(int result, bool cancelled, void *data) {
+    ConnectRemoteArgs *args = connection_finish(data, cancelled);
+    if (args == NULL)
+        return;
+
+    if (result != GS_OK) {
+        char message[256];
+        stream_error(result, args->config, &args->stream, message, sizeof(message));
+        fprintf(stderr, "%s\n", message);
+        sdl_banner(args->ctx, "%s", "red", message);
+        free(args);
+        return;
+    }
+
+    sdl_banner(args->ctx, "Host: %s App: %s", "orange", args->config->address, args->config->app);
+    STREAM_CONFIGURATION stream_config = args->stream;
+    enum platform system = args->system;
+    free(args);
+
+    pair_check(&server);
+    stream(&server, &config, &stream_config, system);
+}
+
+void launchApp(SDLContext *ctx) {
+    char message[256];
+    enum platform system = stream_platform(&config, message, sizeof(message));
+    if (system == 0) {
+        fprintf(stderr, "%s\n", message);
+        sdl_banner(ctx, "%s", "red", message);
+        return;
+    }
+
+    ConnectRemoteArgs *args = connection_args(ctx);
+    if (args == NULL)
+        return;
+
+    stream_inputs(&config, system);
+    args->stream = config.stream;
+    args->system = system;
+    args->gamepad_mask = stream_gamepad_mask();
+    connection_submit(ctx, "launch", launch_run, launch_done, args);
+}
+
+int handleStreaming(PSERVER_DATA server, CONFIGURATION *config) {
+    pair_check(server);
+
+    char message[256];
+    enum platform system = stream_platform(config, message, sizeof(message));
+    if (system == 0) {
+      fprintf(stderr, "%s\n", message);
+      return -1;
+    }
+
+    stream_inputs(config, system);
+    STREAM_CONFIGURATION stream_config = config->stream;
+    int ret = stream_start_app(server, config, &stream_config, stream_gamepad_mask());
+    if (ret != GS_OK) {
+      stream_error(ret, config, &stream_config, message, sizeof(message));
+      fprintf(stderr, "%s\n", message);
+      return -1;
+    }
+
+    stream(server, config, &stream_config, system);
+    return 0;
+}
+
+int connection_stream(PSERVER_DATA server, PCONFIGURATION config) {
+  if (config->address == NULL) {
+    fprintf(stderr, "Specify the host to stream from\n");
+    return -1;
+  }
+
+  enum platform system = platform_check(config->platform);
+  if (system == SDL) {
+    fprintf(stderr, "Streaming with SDL starts from the menu, select another platform\n");
+    return -1;
+  }
+
+  int ret = connect_host(server, config);
+  if (ret != GS_OK) {
+    fprintf(stderr, "Can't connect to %s: %s\n", config->address, gs_error ? gs_error : "unknown error");
+    return -1;
+  }
+
+  if (pair_check(server) != 0)
+    return -1;
+
+  if (handleStreaming(server, config) != 0)
+    return -1;
+
+  return connection_error == ML_ERROR_GRACEFUL_TERMINATION ? 0 : -1;
 }
 
 static void connection_terminated(int errorCode) {
+  connection_error = errorCode;
   switch (errorCode) {
   case ML_ERROR_GRACEFUL_TERMINATION:
     printf("Connection has been terminated gracefully.\n");
@@ -491,6 +857,7 @@ static void set_controller_led(unsigned short controllerNumber, unsigned char r,
 }
 
 static void connection_status_update(int status) {
+  connection_status = status;
   switch (status) {
     case CONN_STATUS_OKAY:
       printf("Connection is okay\n");
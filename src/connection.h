@@ -52,18 +52,37 @@ extern CONFIGURATION config;
 extern CONNECTION_LISTENER_CALLBACKS connection_callbacks;
 extern pthread_t main_thread_id;
 extern bool connection_debug;
+// Last CONN_STATUS_* reported by the host
+extern int connection_status;
 extern ConnListenerRumble rumble_handler;
 extern ConnListenerRumbleTriggers rumble_triggers_handler;
 extern ConnListenerSetMotionEventState set_motion_event_state_handler;
 extern ConnListenerSetControllerLED set_controller_led_handler;
 
-int launchConnectRemoteThread(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx);
-int applist(PSERVER_DATA server, char ***appNames);
+// Serializes gs_* calls between the UI and background threads
+void connection_lock(void);
+void connection_unlock(void);
 int get_app_id(PSERVER_DATA server, const char *name);
-void stream(PSERVER_DATA server, PCONFIGURATION config, enum platform system);
+void stream(PSERVER_DATA server, PCONFIGURATION config, PSTREAM_CONFIGURATION stream_config, enum platform system);
 int pair_check(PSERVER_DATA server);
 void quitRemote(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx);
-void connectRemote(PSERVER_DATA server, CONFIGURATION *config, SDLContext *ctx);
+// Connecting, pairing, unpairing and launching an app run as background
+// tasks, their banners are drawn when the menu dispatches their progress
+// and results. Only one runs at a time. trace times the connection in the
+// startup trace.
+void connectRemote(SDLContext *ctx, bool trace);
 void pairClient(SDLContext *ctx);
 void unPairClient(SDLContext *ctx);
-void handleStreaming(PSERVER_DATA server, CONFIGURATION *config);
\ No newline at end of file
+// Launches config.app
+void launchApp(SDLContext *ctx);
+// Tells the user and returns true while a task runs
+bool connection_busy(SDLContext *ctx);
+// Abandons the running task, false when there is none
+bool connection_cancel(SDLContext *ctx);
+// Starts config->app and streams it until the session ends, -1 when it
+// couldn't start
+int handleStreaming(PSERVER_DATA server, CONFIGURATION *config);
+// Runs the stream action of the command line without the menu and returns
+// once the session ended, 0 unless it failed. With the fake platform it
+// needs neither a display nor input devices.
+int connection_stream(PSERVER_DATA server, PCONFIGURATION config);
\ No newline at end of file
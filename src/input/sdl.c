@@ -27,6 +27,8 @@
 #define QUIT_BUTTONS (PLAY_FLAG|BACK_FLAG|LB_FLAG|RB_FLAG)
 #define FULLSCREEN_KEY SDLK_f
 #define UNGRAB_KEY SDLK_z
+#define OVERLAY_KEY SDLK_s
+#define OVERLAY_BUTTONS (PLAY_FLAG|BACK_FLAG|Y_FLAG)
 
 static const int SDL_TO_LI_BUTTON_MAP[] = {
   A_FLAG, B_FLAG, X_FLAG, Y_FLAG,
@@ -326,6 +328,8 @@ int sdlinput_handle_event(SDL_Window* window, SDL_Event* event) {
       return SDL_TOGGLE_FULLSCREEN;
     else if ((keyboard_modifiers & ACTION_MODIFIERS) == ACTION_MODIFIERS && event->key.keysym.sym == UNGRAB_KEY && event->type==SDL_KEYUP)
       return SDL_GetRelativeMouseMode() ? SDL_MOUSE_UNGRAB : SDL_MOUSE_GRAB;
+    else if ((keyboard_modifiers & ACTION_MODIFIERS) == ACTION_MODIFIERS && event->key.keysym.sym == OVERLAY_KEY && event->type==SDL_KEYUP)
+      return SDL_TOGGLE_OVERLAY;
     break;
   case SDL_FINGERDOWN:
   case SDL_FINGERMOTION:
@@ -394,6 +398,10 @@ int sdlinput_handle_event(SDL_Window* window, SDL_Event* event) {
 
     if ((gamepad->buttons & QUIT_BUTTONS) == QUIT_BUTTONS)
       return SDL_QUIT_APPLICATION;
+    // Only toggle once, when the last button of the combination goes down
+    if (event->type == SDL_CONTROLLERBUTTONDOWN && (gamepad->buttons & OVERLAY_BUTTONS) == OVERLAY_BUTTONS &&
+        (SDL_TO_LI_BUTTON_MAP[event->cbutton.button] & OVERLAY_BUTTONS))
+      return SDL_TOGGLE_OVERLAY;
 
     LiSendMultiControllerEvent(gamepad->id, activeGamepadMask, gamepad->buttons, gamepad->leftTrigger, gamepad->rightTrigger, gamepad->leftStickX, gamepad->leftStickY, gamepad->rightStickX, gamepad->rightStickY);
     break;
@@ -0,0 +1,169 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency.h"
+
+#include <Limelight.h>
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Log-linear buckets, exact below LINEAR_BUCKETS microseconds and four
+// buckets per power of two above, which keeps percentiles within 25%
+#define LINEAR_BUCKETS 16
+#define SUB_BUCKET_BITS 2
+#define BUCKET_COUNT 128
+
+typedef struct _LATENCY_HISTOGRAM {
+  uint64_t buckets[BUCKET_COUNT];
+  uint64_t sum;
+  uint64_t max;
+} LATENCY_HISTOGRAM;
+
+static LATENCY_HISTOGRAM histograms[LATENCY_STAGES];
+static int dump_requested;
+
+static const char* stage_names[LATENCY_STAGES] = {
+  [LATENCY_SUBMIT] = "submit",
+  [LATENCY_SEND_PACKET] = "send packet",
+  [LATENCY_RECEIVE_FRAME] = "receive frame",
+  [LATENCY_DECODED] = "decoded",
+  [LATENCY_UPLOAD] = "upload",
+  [LATENCY_PRESENT] = "present",
+  [LATENCY_QUEUED] = "queued",
+  [LATENCY_END_TO_END] = "end to end",
+};
+
+static int latency_bucket(uint64_t us) {
+  if (us < LINEAR_BUCKETS)
+    return us;
+
+  int exponent = 63 - __builtin_clzll(us);
+  int bucket = LINEAR_BUCKETS + (exponent - 4) * (1 << SUB_BUCKET_BITS) + ((us >> (exponent - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1));
+  return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+}
+
+// Largest value counted in a bucket
+static uint64_t latency_bucket_limit(int bucket) {
+  if (bucket < LINEAR_BUCKETS)
+    return bucket;
+
+  int exponent = (bucket - LINEAR_BUCKETS) / (1 << SUB_BUCKET_BITS) + 4;
+  int sub = (bucket - LINEAR_BUCKETS) % (1 << SUB_BUCKET_BITS);
+  return ((uint64_t) ((1 << SUB_BUCKET_BITS) + sub + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+static void latency_signal(int sig) {
+  __atomic_store_n(&dump_requested, 1, __ATOMIC_RELAXED);
+}
+
+void latency_init(void) {
+  memset(histograms, 0, sizeof(histograms));
+  dump_requested = 0;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = latency_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, NULL);
+}
+
+uint64_t latency_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void latency_record(enum latency_stage stage, uint64_t us) {
+  LATENCY_HISTOGRAM* histogram = &histograms[stage];
+  __atomic_fetch_add(&histogram->buckets[latency_bucket(us)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&histogram->sum, us, __ATOMIC_RELAXED);
+
+  uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+  while (us > max && !__atomic_compare_exchange_n(&histogram->max, &max, us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  // The signal handler can't print, the next recording thread does
+  if (__atomic_load_n(&dump_requested, __ATOMIC_RELAXED) && __atomic_exchange_n(&dump_requested, 0, __ATOMIC_RELAXED))
+    latency_dump();
+}
+
+void latency_record_since(enum latency_stage stage, uint64_t start_us) {
+  uint64_t now = latency_now_us();
+  latency_record(stage, now > start_us ? now - start_us : 0);
+}
+
+void latency_record_host(enum latency_stage stage, uint64_t receive_ms) {
+  uint64_t now = LiGetMillis();
+  latency_record(stage, now > receive_ms ? (now - receive_ms) * 1000 : 0);
+}
+
+static uint64_t latency_percentile(const uint64_t* buckets, uint64_t count, uint64_t max, int percentile) {
+  uint64_t target = (count * percentile + 99) / 100;
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKET_COUNT; i++) {
+    seen += buckets[i];
+    if (seen >= target) {
+      uint64_t limit = latency_bucket_limit(i);
+      return limit < max ? limit : max;
+    }
+  }
+
+  return max;
+}
+
+// Recording continues while reading, so the snapshot may be off by a few samples
+void latency_get_stats(enum latency_stage stage, PLATENCY_STATS stats) {
+  LATENCY_HISTOGRAM* histogram = &histograms[stage];
+  uint64_t buckets[BUCKET_COUNT];
+  uint64_t count = 0;
+  for (int i = 0; i < BUCKET_COUNT; i++) {
+    buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+    count += buckets[i];
+  }
+
+  memset(stats, 0, sizeof(*stats));
+  if (count == 0)
+    return;
+
+  stats->count = count;
+  stats->max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+  stats->mean = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED) / count;
+  stats->p50 = latency_percentile(buckets, count, stats->max, 50);
+  stats->p95 = latency_percentile(buckets, count, stats->max, 95);
+  stats->p99 = latency_percentile(buckets, count, stats->max, 99);
+}
+
+void latency_dump(void) {
+  bool header = false;
+  for (int i = 0; i < LATENCY_STAGES; i++) {
+    LATENCY_STATS stats;
+    latency_get_stats(i, &stats);
+    if (stats.count == 0)
+      continue;
+
+    if (!header) {
+      printf("Latency (ms)   %8s %7s %7s %7s %7s %7s\n", "frames", "mean", "p50", "p95", "p99", "max");
+      header = true;
+    }
+    printf("%-14s %8llu %7.1f %7.1f %7.1f %7.1f %7.1f\n", stage_names[i], (unsigned long long) stats.count,
+           stats.mean / 1000.0, stats.p50 / 1000.0, stats.p95 / 1000.0, stats.p99 / 1000.0, stats.max / 1000.0);
+  }
+}
@@ -0,0 +1,57 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Stages of the video pipeline, durations unless noted otherwise
+enum latency_stage {
+  LATENCY_SUBMIT,          // host frame received until submitDecodeUnit
+  LATENCY_SEND_PACKET,     // handing a decode unit to the decoder
+  LATENCY_RECEIVE_FRAME,   // taking a decoded frame from the decoder
+  LATENCY_DECODED,         // host frame received until decoded
+  LATENCY_UPLOAD,          // texture upload or conversion
+  LATENCY_PRESENT,         // presenting the frame
+  LATENCY_QUEUED,          // decoded frame queued until presented
+  LATENCY_END_TO_END,      // host frame received until presented
+  LATENCY_STAGES
+};
+
+typedef struct _LATENCY_STATS {
+  uint64_t count;
+  uint64_t mean;
+  uint64_t p50;
+  uint64_t p95;
+  uint64_t p99;
+  uint64_t max;
+} LATENCY_STATS, *PLATENCY_STATS;
+
+// Clears all histograms, SIGUSR1 prints them while streaming
+void latency_init(void);
+
+// Monotonic time in microseconds
+uint64_t latency_now_us(void);
+
+// Safe to call from any thread, values are in microseconds
+void latency_record(enum latency_stage stage, uint64_t us);
+void latency_record_since(enum latency_stage stage, uint64_t start_us);
+// receive_ms is a LiGetMillis timestamp like decodeUnit->receiveTimeMs
+void latency_record_host(enum latency_stage stage, uint64_t receive_ms);
+
+void latency_get_stats(enum latency_stage stage, PLATENCY_STATS stats);
+void latency_dump(void);
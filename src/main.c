@@ -18,21 +18,37 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "loop.h"
 #include "sdl.h"
 #include "platform.h"
 #include "config.h"
 #include "configuration.h"
+#include "startup.h"
+#include "connection.h"
 
 int main(int argc, char* argv[]) {
+    startup_init();
     printf("Moonlight Embedded %d.%d.%d (%s)\n", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH, COMPILE_OPTIONS);
     
+    // Also parses MOONLIGHT_CONF
+    int phase = startup_begin("config");
     config_default(config);
-    config_file_parse(MOONLIGHT_CONF, &config);
+    config_parse(argc, argv, &config);
+    startup_end(phase);
     
-    sdl_init(&ctx, 640, 480, true);
+    // An action skips the menu, so sessions can also run headless
+    if (config.action != NULL) {
+        if (strcmp(config.action, "stream") != 0) {
+            fprintf(stderr, "Unknown action %s\n", config.action);
+            return 1;
+        }
+        return connection_stream(&server, &config) == 0 ? 0 : 1;
+    }
+    
+    sdl_init(&ctx, PANEL_WIDTH, PANEL_HEIGHT, true);
     
-    config_save(MOONLIGHT_CONF, &config);
+    config_save_settings(&config);
     
     if (config.address != NULL) {
         free(config.address);
@@ -0,0 +1,181 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_SDL
+
+#include "overlay.h"
+#include "connection.h"
+#include "text_cache.h"
+#include "video/ffmpeg.h"
+#include "video/mailbox.h"
+#include "video/decode_queue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define OVERLAY_INTERVAL 500
+#define OVERLAY_FONT_SIZE 16
+#define OVERLAY_LINES 6
+#define OVERLAY_LINE_LENGTH 64
+#define OVERLAY_LINE_HEIGHT 20
+#define OVERLAY_PADDING 6
+#define OVERLAY_WIDTH 260
+
+typedef struct _OVERLAY_COUNTERS {
+    Uint32 time;
+    uint64_t received;
+    uint64_t bytes;
+    uint64_t decoded;
+    uint64_t presented;
+} OVERLAY_COUNTERS;
+
+static bool visible, redraw_all;
+static SDL_Rect overlay_rect = {8, 8, OVERLAY_WIDTH, OVERLAY_LINES * OVERLAY_LINE_HEIGHT + 2 * OVERLAY_PADDING};
+static char lines[OVERLAY_LINES][OVERLAY_LINE_LENGTH];
+static OVERLAY_COUNTERS last;
+static Uint32 next_update;
+
+void overlay_init(bool show) {
+    visible = show;
+    redraw_all = true;
+    memset(&last, 0, sizeof(last));
+    next_update = SDL_GetTicks();
+}
+
+void overlay_toggle(void) {
+    visible = !visible;
+    redraw_all = true;
+    memset(&last, 0, sizeof(last));
+    next_update = SDL_GetTicks();
+}
+
+void overlay_destroy(void) {
+    memset(lines, 0, sizeof(lines));
+}
+
+static void overlay_sample(OVERLAY_COUNTERS *counters) {
+    SDL_VIDEO_STATS video_stats;
+    FFMPEG_FRAME_STATS frame_stats;
+    MAILBOX_STATS mailbox_stats;
+
+    sdl_video_get_stats(&video_stats);
+    ffmpeg_get_frame_stats(&frame_stats);
+    mailbox_get_stats(&mailbox_stats);
+
+    counters->time = SDL_GetTicks();
+    counters->received = video_stats.received_units;
+    counters->bytes = video_stats.received_bytes;
+    counters->decoded = frame_stats.received;
+    counters->presented = mailbox_stats.presented;
+}
+
+static uint64_t overlay_dropped(void) {
+    FFMPEG_FRAME_STATS frame_stats;
+    FFMPEG_DROP_STATS drop_stats;
+    MAILBOX_STATS mailbox_stats;
+    DECODE_QUEUE_STATS queue_stats;
+
+    ffmpeg_get_frame_stats(&frame_stats);
+    ffmpeg_get_drop_stats(&drop_stats);
+    mailbox_get_stats(&mailbox_stats);
+    decode_queue_get_stats(&queue_stats);
+
+    return frame_stats.exhausted + drop_stats.backlog + mailbox_stats.superseded + queue_stats.dropped;
+}
+
+// Formats the current values, returns false while there is nothing to compare against yet
+static bool overlay_format(char text[OVERLAY_LINES][OVERLAY_LINE_LENGTH]) {
+    OVERLAY_COUNTERS now;
+    overlay_sample(&now);
+
+    bool valid = last.time != 0 && now.time != last.time && now.received >= last.received;
+    if (valid) {
+        double seconds = (now.time - last.time) / 1000.0;
+        snprintf(text[0], OVERLAY_LINE_LENGTH, "Received %5.1f fps %5.1f Mbps", (now.received - last.received) / seconds, (now.bytes - last.bytes) * 8 / seconds / 1000000);
+        snprintf(text[1], OVERLAY_LINE_LENGTH, "Decoded %5.1f fps %5.1f ms", (now.decoded - last.decoded) / seconds, ffmpeg_get_decode_time() / 1000.0);
+        snprintf(text[2], OVERLAY_LINE_LENGTH, "Presented %5.1f fps", (now.presented - last.presented) / seconds);
+        snprintf(text[3], OVERLAY_LINE_LENGTH, "Dropped %llu frames", (unsigned long long) overlay_dropped());
+        snprintf(text[4], OVERLAY_LINE_LENGTH, "Audio queue %d ms", sdl_audio_queued_ms());
+        snprintf(text[5], OVERLAY_LINE_LENGTH, "Connection %s", connection_status == CONN_STATUS_POOR ? "poor" : "okay");
+    }
+
+    last = now;
+    return valid;
+}
+
+// Rasterizes changed lines into the menu surface and uploads them
+static void overlay_update(SDLContext *ctx) {
+    char text[OVERLAY_LINES][OVERLAY_LINE_LENGTH] = {{0}};
+    if (!overlay_format(text) && !redraw_all)
+        return;
+
+    SDL_Surface *surface = ctx->menu_surface;
+    Uint32 background = SDL_MapRGB(surface->format, 0, 0, 0);
+    if (redraw_all) {
+        SDL_FillRect(surface, &overlay_rect, background);
+        memset(lines, 0, sizeof(lines));
+        if (text[0][0] == '\0')
+            snprintf(text[0], OVERLAY_LINE_LENGTH, "Collecting statistics...");
+    }
+
+    bool changed = redraw_all;
+    for (int i = 0; i < OVERLAY_LINES; i++) {
+        if (strcmp(text[i], lines[i]) == 0)
+            continue;
+
+        strcpy(lines[i], text[i]);
+        changed = true;
+
+        SDL_Rect line_rect = {overlay_rect.x + OVERLAY_PADDING, overlay_rect.y + OVERLAY_PADDING + i * OVERLAY_LINE_HEIGHT, overlay_rect.w - 2 * OVERLAY_PADDING, OVERLAY_LINE_HEIGHT};
+        SDL_FillRect(surface, &line_rect, background);
+        if (lines[i][0] == '\0')
+            continue;
+
+        // Shaded text is a palettized surface, much cheaper to blit than blended text
+        SDL_Color foreground = (i == 5 && connection_status == CONN_STATUS_POOR) ? (SDL_Color) {255, 105, 97, 255} : (SDL_Color) {255, 255, 255, 255};
+        SDL_Surface *text_surface = text_cache_render_shaded(lines[i], OVERLAY_FONT_SIZE, foreground, (SDL_Color) {0, 0, 0, 255});
+        if (text_surface == NULL)
+            continue;
+
+        SDL_Rect source = {0, 0, SDL_min(text_surface->w, line_rect.w), SDL_min(text_surface->h, line_rect.h)};
+        SDL_BlitSurface(text_surface, &source, surface, &line_rect);
+        SDL_FreeSurface(text_surface);
+    }
+
+    redraw_all = false;
+    if (changed) {
+        Uint8 *pixels = (Uint8 *) surface->pixels + overlay_rect.y * surface->pitch + overlay_rect.x * surface->format->BytesPerPixel;
+        SDL_UpdateTexture(ctx->menu_texture, &overlay_rect, pixels, surface->pitch);
+    }
+}
+
+void overlay_draw(SDLContext *ctx) {
+    if (!visible || !ctx->menu_surface || !ctx->menu_texture)
+        return;
+
+    Uint32 now = SDL_GetTicks();
+    if (redraw_all || SDL_TICKS_PASSED(now, next_update)) {
+        next_update = now + OVERLAY_INTERVAL;
+        overlay_update(ctx);
+        if (!visible)
+            return;
+    }
+
+    SDL_RenderCopy(ctx->renderer, ctx->menu_texture, &overlay_rect, &overlay_rect);
+}
+
+#endif /* HAVE_SDL */
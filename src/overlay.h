@@ -0,0 +1,34 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_SDL
+
+#include "sdl.h"
+
+#include <stdbool.h>
+
+// Statistics drawn over the stream, text is only rasterized again when a
+// value changed and at most twice a second
+void overlay_init(bool visible);
+void overlay_toggle(void);
+// Call after copying the video frame, before presenting
+void overlay_draw(SDLContext *ctx);
+void overlay_destroy(void);
+
+#endif /* HAVE_SDL */
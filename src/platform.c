@@ -107,6 +107,16 @@ enum platform platform_check(char* name) {
 
 void platform_start(enum platform system) {
   switch (system) {
+  #ifdef HAVE_SDL
+  case SDL:
+    sdl_video_prepare();
+    break;
+  #endif
+  #ifdef HAVE_FAKE
+  case FAKE:
+    fake_video_prepare();
+    break;
+  #endif
   #ifdef HAVE_AML
   case AML:
     write_bool("/sys/class/graphics/fb0/blank", true);
@@ -156,6 +166,10 @@ DECODER_RENDERER_CALLBACKS* platform_get_video(enum platform system) {
   case SDL:
     return &decoder_callbacks_sdl;
   #endif
+  #ifdef HAVE_FAKE
+  case FAKE:
+    return &decoder_callbacks_fake;
+  #endif
   #ifdef HAVE_IMX
   case IMX:
     return (PDECODER_RENDERER_CALLBACKS) dlsym(RTLD_DEFAULT, "decoder_callbacks_imx");
@@ -183,7 +197,7 @@ DECODER_RENDERER_CALLBACKS* platform_get_video(enum platform system) {
 AUDIO_RENDERER_CALLBACKS* platform_get_audio(enum platform system, char* audio_device) {
   switch (system) {
   case FAKE:
-      return NULL;
+    return &audio_callbacks_fake;
   #ifdef HAVE_SDL
   case SDL:
     return &audio_callbacks_sdl;
@@ -247,7 +261,7 @@ char* platform_name(enum platform system) {
   case SDL:
     return "SDL2 (software decoding)";
   case FAKE:
-    return "Fake (no a/v output)";
+    return "Fake (offscreen video, null audio)";
   default:
     return "Unknown";
   }
@@ -32,6 +32,21 @@
 #include "connection.h"
 #include <Limelight.h>
 #include "util.h"
+#include "latency.h"
+#include "overlay.h"
+#include "text_cache.h"
+#include "app_catalog.h"
+#include "boxart.h"
+#include "ui_bundle.h"
+#include "startup.h"
+#include "task.h"
+#include "video/ffmpeg.h"
+#include "video/pacing.h"
+#include "video/yuv2rgb565.h"
+
+#include <libavutil/pixdesc.h>
+
+#include <pthread.h>
 
 SDLContext ctx;
 SERVER_DATA server;
@@ -39,12 +54,29 @@ CONFIGURATION config;
 
 static bool done;
 static int fullscreen_flags;
-SDL_mutex *mutex;
-int sdlCurrentFrame, sdlNextFrame;
+
+// Formats the renderer supports natively, others are emulated by SDL
+// with a software conversion on every upload
+static Uint32 renderer_formats[16];
+static int renderer_format_count;
+static bool rgb565_ready;
+
+static void sdl_calibrate_uploads(SDLContext *ctx);
+
+// Tiles of the current menu pre-rendered once per full redraw, the normal
+// state in the left column of the atlas and the selected state in the
+// right one, so moving the selection only copies two tiles
+static SDL_Surface *tile_atlas;
+static SDL_Rect *tile_rects;
+static int tile_count, tile_selected = -1;
+
 int eventPending = 0;
 int pair_eval = 0;
-char **global_app_names = NULL;
+const char **global_app_names = NULL;
 int global_app_count = 0;
+// Snapshot of the app list shown, global_app_names points into it
+static const APP_CATALOG *shown_apps;
+static uint64_t shown_apps_generation, shown_art_generation;
 
 void sdl_base_ui(SDLContext *ctx) {
     SDL_FillRect(ctx->menu_surface, NULL, SDL_MapRGB(ctx->menu_surface->format, 0, 0, 0));
@@ -65,14 +97,78 @@ void sdl_base_ui(SDLContext *ctx) {
     }
 }
 
+// Everything the first menu frame needs that doesn't touch the renderer,
+// loaded while SDL sets up the window and renderer
+static void *sdl_load_assets(void *data) {
+    SDLContext *ctx = data;
+    int phase = startup_begin("assets");
+
+    if(TTF_Init()) {
+        fprintf(stderr, "Could not initialize TTF - %s\n", SDL_GetError());
+        exit(1);
+    }
+    ui_bundle_init();
+    text_cache_init();
+
+    ctx->menu_surface = SDL_CreateRGBSurface(0, 640, 480, 16, 0xF800, 0x07E0, 0x001F, 0x0000);
+    ctx->cached_top_banner = ui_bundle_image("top_banner");
+    if (!ctx->cached_top_banner) {
+        ctx->cached_top_banner = IMG_Load(TOP_BANNER);
+        if (!ctx->cached_top_banner) {
+            fprintf(stderr, "Could not load PNG image: %s\n", IMG_GetError());
+        }
+    }
+
+    startup_end(phase);
+    return NULL;
+}
+
+// Work the first menu frame doesn't wait for, done once it's on screen
+static void sdl_startup_deferred(SDLContext *ctx) {
+    static bool done;
+    if (done)
+        return;
+
+    done = true;
+    startup_interactive();
+    // Progress and results posted before SDL could queue the wake up
+    task_dispatch();
+
+    int phase = startup_begin("boxart");
+    boxart_init(&server);
+    startup_end(phase);
+
+    // The video texture is created by the render loop once the stream size
+    // is known, with SDL scaling RGB565 is a candidate converted like nearest
+    phase = startup_begin("yuv2rgb565");
+    rgb565_ready = yuv2rgb565_init(config.scaler == SCALER_BILINEAR ? YUV_SCALE_BILINEAR : YUV_SCALE_NEAREST) == 0;
+    startup_end(phase);
+
+    phase = startup_begin("upload calibration");
+    sdl_calibrate_uploads(ctx);
+    startup_end(phase);
+
+    startup_write();
+}
+
 void sdl_init(SDLContext *ctx, int width, int height, bool fullscreen) {
-    ctx->sdlCurrentFrame = ctx->sdlNextFrame = 0;
+    // Loading the certificate and reaching the host take longest, start them first
+    task_init();
+    connectRemote(ctx, true);
+
+    pthread_t assets_thread;
+    bool assets_threaded = pthread_create(&assets_thread, NULL, sdl_load_assets, ctx) == 0;
+    if (!assets_threaded)
+        sdl_load_assets(ctx);
 
+    int phase = startup_begin("SDL_Init");
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS)) {
         fprintf(stderr, "Could not initialize SDL - %s\n", SDL_GetError());
         exit(1);
     }
+    startup_end(phase);
 
+    phase = startup_begin("renderer");
     Uint32 fullscreen_flags = fullscreen ? SDL_WINDOW_FULLSCREEN : 0;
     ctx->window = SDL_CreateWindow("Moonlight", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL | fullscreen_flags);
 
@@ -87,40 +183,30 @@ void sdl_init(SDLContext *ctx, int width, int height, bool fullscreen) {
     exit(1);
     }
 
-    ctx->bmp = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_YV12, SDL_TEXTUREACCESS_STREAMING, width, height);
-    if (!ctx->bmp) {
-    fprintf(stderr, "SDL: could not create texture - exiting\n");
-    exit(1);
-    }
-
-    mutex = SDL_CreateMutex();
-    if (!mutex) {
-    fprintf(stderr, "Couldn't create mutex\n");
-    exit(1);
-    }
-
     SDL_RendererInfo info;
     if (SDL_GetRendererInfo(ctx->renderer, &info) == 0) {
         printf("Renderer Name: %s\n", info.name);
+        renderer_format_count = 0;
         for (Uint32 i = 0; i < info.num_texture_formats; i++) {
             printf("Texture Format %d: %s\n", i, SDL_GetPixelFormatName(info.texture_formats[i]));
+            if (renderer_format_count < (int) (sizeof(renderer_formats) / sizeof(renderer_formats[0])))
+                renderer_formats[renderer_format_count++] = info.texture_formats[i];
         }
     }
     
-    ctx->menu_surface = SDL_CreateRGBSurface(0, 640, 480, 16, 0xF800, 0x07E0, 0x001F, 0x0000);
     ctx->menu_texture = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING, 640, 480);
+    startup_end(phase);
+
+    phase = startup_begin("splash");
+    sdl_splash(ctx);
+    startup_end(phase);
     
-    if(TTF_Init()) {
-        fprintf(stderr, "Could not initialize TTF - %s\n", SDL_GetError());
-        exit(1);
-    }
-    
-    ctx->cached_top_banner = IMG_Load(TOP_BANNER);
-    if (!ctx->cached_top_banner) {
-        fprintf(stderr, "Could not load PNG image: %s\n", IMG_GetError());
+    if (assets_threaded) {
+        phase = startup_begin("assets wait");
+        pthread_join(assets_thread, NULL);
+        startup_end(phase);
     }
-    
-    launchConnectRemoteThread(&server, &config, ctx);
+
     sdl_base_ui(ctx);
     sdl_menu(ctx);  
 }
@@ -136,12 +222,20 @@ void cleanupSDLContext(SDLContext *ctx) {
         if (ctx->bmp) {
             SDL_DestroyTexture(ctx->bmp);
         }
+        yuv2rgb565_destroy();
         if (ctx->mutex) {
             SDL_DestroyMutex(ctx->mutex);
         }
         if (ctx->menu_surface) {
             SDL_FreeSurface(ctx->menu_surface);
         }
+        if (ctx->cached_top_banner) {
+            SDL_FreeSurface(ctx->cached_top_banner);
+        }
+        if (tile_atlas) {
+            SDL_FreeSurface(tile_atlas);
+            tile_atlas = NULL;
+        }
         if (ctx->menu_texture) {
             SDL_DestroyTexture(ctx->menu_texture);
         }
@@ -149,7 +243,10 @@ void cleanupSDLContext(SDLContext *ctx) {
             TTF_CloseFont(ctx->font);
         }
         memset(ctx, 0, sizeof(SDLContext));
-        config_save(MOONLIGHT_CONF, &config); 
+        config_save_settings(&config);
+        boxart_destroy();
+        text_cache_destroy();
+        ui_bundle_destroy();
         TTF_Quit();
         SDL_Quit();
         exit(-1); 
@@ -163,36 +260,20 @@ void sdl_ip_input(SDLContext *ctx, SDL_Rect text_box_rect) {
         return;
     }
 
-    TTF_Font *font = TTF_OpenFont(MOONLIGHT_FONT, 30);
-    if (!font) {
-        fprintf(stderr, "TTF_OpenFont failed: %s\n", TTF_GetError());
-        return;
-    }
-
     const char *text_to_render = ctx->state.entered_ip;
     text_to_render = "Enter IP";
 
     SDL_Color text_color = {255, 255, 255, 0};
-    SDL_Surface *text_surface = TTF_RenderText_Blended(font, text_to_render, text_color);
-    
-    if (!text_surface) {
-        fprintf(stderr, "TTF_RenderText_Blended failed: %s\n", TTF_GetError());
-        TTF_CloseFont(font);
+    SDL_Rect text_rect;
+    SDL_Texture *text_texture = text_cache_texture(ctx->renderer, text_to_render, 30, text_color, &text_rect.w, &text_rect.h);
+    if (!text_texture)
         return;
-    }
 
-    SDL_Rect text_rect;
-    text_rect.x = text_box_rect.x + (text_box_rect.w - text_surface->w) / 2;
-    text_rect.y = text_box_rect.y + (text_box_rect.h - text_surface->h) / 2;
-    text_rect.w = text_surface->w;
-    text_rect.h = text_surface->h;
-    
-    SDL_Texture *text_texture = SDL_CreateTextureFromSurface(ctx->renderer, text_surface);
+    text_rect.x = text_box_rect.x + (text_box_rect.w - text_rect.w) / 2;
+    text_rect.y = text_box_rect.y + (text_box_rect.h - text_rect.h) / 2;
     SDL_RenderCopy(ctx->renderer, text_texture, NULL, &text_rect);
 
-    SDL_FreeSurface(text_surface);
     SDL_DestroyTexture(text_texture);
-    TTF_CloseFont(font);
 }
 
 void sdl_ip_input_gui(SDLContext *ctx) {
@@ -220,7 +301,7 @@ void sdl_banner(SDLContext *ctx, const char *format, const char *color, ...) {
     // printf("Entered banner\n");
     if (!ctx || !ctx->menu_surface) return;
     
-    char message[256];
+    char message[SDL_BANNER_LENGTH];
     va_list args;
     
     va_start(args, color);
@@ -246,31 +327,9 @@ void sdl_banner(SDLContext *ctx, const char *format, const char *color, ...) {
     SDL_FillRect(ctx->menu_surface, &rect, bannerColor);
 
     if (message[0] != '\0') {
-        TTF_Font *font = TTF_OpenFont(MOONLIGHT_FONT, 26);
-        if (font == NULL) {
-            fprintf(stderr, "Could not load font: %s\n", TTF_GetError());
-            return;
-        }
-
         SDL_Color textColor = {255, 255, 255, 255};
-        SDL_Surface *textSurface = TTF_RenderText_Blended(font, message, textColor);
-
-        if(!textSurface) {
-            fprintf(stderr, "Could not render text: %s\n", TTF_GetError());
-            TTF_CloseFont(font);
+        if (!text_cache_draw(ctx->menu_surface, &rect, message, 26, textColor))
             return;
-        }
-
-        SDL_Rect textRect;
-        textRect.x = (rect.w - textSurface->w) / 2;
-        textRect.y = rect.y + (rect.h - textSurface->h) / 2;
-        textRect.w = textSurface->w;
-        textRect.h = textSurface->h;
-
-        SDL_BlitSurface(textSurface, NULL, ctx->menu_surface, &textRect);
-
-        SDL_FreeSurface(textSurface);
-        TTF_CloseFont(font);
     }
 
     SDL_Texture* menu_texture = SDL_CreateTextureFromSurface(ctx->renderer, ctx->menu_surface);
@@ -302,33 +361,15 @@ void sdl_draw_textbox(SDLContext *ctx, SDL_Surface* surface, const char* message
     Uint32 box_color = SDL_MapRGB(surface->format, 211, 211, 211);
     SDL_FillRect(surface, &box_rect, box_color);
 
-    if (TTF_Init() == -1) {
-        fprintf(stderr, "Could not initialize SDL_ttf: %s\n", TTF_GetError());
-        return;
-    }
-    TTF_Font *font = TTF_OpenFont(MOONLIGHT_FONT, 30);
-    if (font == NULL) {
-        fprintf(stderr, "Could not load font: %s\n", TTF_GetError());
-        TTF_Quit();
-        return;
-    }
-
     SDL_Color textColor = {0, 0, 0, 0};
-    SDL_Surface* textSurface = TTF_RenderText_Blended(font, displayMessage, textColor);
-    SDL_Rect textRect;
-    textRect.x = box_start_x + (box_rect.w - textSurface->w) / 2;
-    textRect.y = box_start_y + (box_rect.h - textSurface->h) / 2;
-    textRect.w = textSurface->w;
-    textRect.h = textSurface->h;
-
-    SDL_BlitSurface(textSurface, NULL, surface, &textRect);
-
-    SDL_FreeSurface(textSurface);
-    TTF_CloseFont(font);
-    TTF_Quit();
+    text_cache_draw(surface, &box_rect, displayMessage, 30, textColor);
 }
 
-void sdl_tile(SDLContext *ctx, SDL_Surface* surface, int columns, int rows, int selected, int index, const char **labels, int numItems, int font_size, int isAppSelection) {
+// Height of the colored bands at the top and bottom of a tile
+#define TILE_BAND_TOP 5
+#define TILE_BANDS 15
+
+static SDL_Rect sdl_tile_rect(SDLContext *ctx, int columns, int rows, int index, int numItems, int isAppSelection) {
     int screen_width = 640;
     int screen_height = 480;
     int padding = 20;
@@ -370,7 +411,11 @@ void sdl_tile(SDLContext *ctx, SDL_Surface* surface, int columns, int rows, int
     rect.y = startY + y * (tile_height + tile_gap);
     rect.w = tile_width;
     rect.h = tile_height;
-    Uint32 bg_color = (selected == index) ? SDL_MapRGB(surface->format, 144, 144, 144) : SDL_MapRGB(surface->format, 108, 108, 108);
+    return rect;
+}
+
+static void sdl_paint_tile(SDL_Surface* surface, SDL_Rect rect, bool selected, const char *label, int font_size, SDL_Surface *art) {
+    Uint32 bg_color = selected ? SDL_MapRGB(surface->format, 144, 144, 144) : SDL_MapRGB(surface->format, 108, 108, 108);
     SDL_FillRect(surface, &rect, bg_color);
 
     SDL_Rect bandRectBottom;
@@ -378,7 +423,7 @@ void sdl_tile(SDLContext *ctx, SDL_Surface* surface, int columns, int rows, int
     bandRectBottom.y = rect.y + rect.h - 10;
     bandRectBottom.w = rect.w;
     bandRectBottom.h = 10;
-    Uint32 band_color_bottom = (selected == index) ? SDL_MapRGB(surface->format, 225, 0, 0) : SDL_MapRGB(surface->format, 98, 98, 98);
+    Uint32 band_color_bottom = selected ? SDL_MapRGB(surface->format, 225, 0, 0) : SDL_MapRGB(surface->format, 98, 98, 98);
     SDL_FillRect(surface, &bandRectBottom, band_color_bottom);
 
     SDL_Rect bandRectTop;
@@ -386,36 +431,96 @@ void sdl_tile(SDLContext *ctx, SDL_Surface* surface, int columns, int rows, int
     bandRectTop.y = rect.y;
     bandRectTop.w = rect.w;
     bandRectTop.h = 5;
-    Uint32 band_color_top = (selected == index) ? SDL_MapRGB(surface->format, 164, 164, 164) : SDL_MapRGB(surface->format, 138, 138, 138);
+    Uint32 band_color_top = selected ? SDL_MapRGB(surface->format, 164, 164, 164) : SDL_MapRGB(surface->format, 138, 138, 138);
     SDL_FillRect(surface, &bandRectTop, band_color_top);
 
-      if (TTF_Init() == -1) {
-        fprintf(stderr, "Could not initialize SDL_ttf: %s\n", TTF_GetError());
+    // Box art replaces the label, centered between the bands
+    if (art) {
+        SDL_Rect artRect = {rect.x + (rect.w - art->w) / 2, rect.y + TILE_BAND_TOP + (rect.h - TILE_BANDS - art->h) / 2, art->w, art->h};
+        SDL_BlitSurface(art, NULL, surface, &artRect);
         return;
     }
-    
-    TTF_Font *font = TTF_OpenFont(MOONLIGHT_FONT, font_size);
-    if (font == NULL) {
-        fprintf(stderr, "Could not load font: %s\n", TTF_GetError());
-        TTF_Quit();
+
+    SDL_Color textColor = {255, 255, 255, 0};
+    text_cache_draw(surface, &rect, label, font_size, textColor);
+}
+
+void sdl_tile(SDLContext *ctx, SDL_Surface* surface, int columns, int rows, int selected, int index, const char **labels, int numItems, int font_size, int isAppSelection) {
+    SDL_Rect rect = sdl_tile_rect(ctx, columns, rows, index, numItems, isAppSelection);
+    sdl_paint_tile(surface, rect, selected == index, labels[index], font_size, NULL);
+}
+
+static void sdl_blit_tile(SDLContext *ctx, int index, bool selected) {
+    SDL_Rect dst = tile_rects[index];
+    SDL_Rect src = {selected ? dst.w : 0, index * dst.h, dst.w, dst.h};
+    SDL_BlitSurface(tile_atlas, &src, ctx->menu_surface, &dst);
+}
+
+// app_ids selects box art for the tiles where it's already loaded
+static void sdl_draw_tiles(SDLContext *ctx, int columns, int rows, int selected, const char **labels, const int *app_ids, int numItems, int font_size, int isAppSelection) {
+    tile_count = 0;
+    tile_selected = -1;
+    if (numItems <= 0)
+        return;
+
+    SDL_Rect *rects = realloc(tile_rects, numItems * sizeof(SDL_Rect));
+    if (rects == NULL)
         return;
+    tile_rects = rects;
+
+    for (int i = 0; i < numItems; i++)
+        tile_rects[i] = sdl_tile_rect(ctx, columns, rows, i, numItems, isAppSelection);
+
+    // All tiles of a menu have the same size
+    int tile_width = tile_rects[0].w, tile_height = tile_rects[0].h;
+    if (tile_atlas == NULL || tile_atlas->w != 2 * tile_width || tile_atlas->h < numItems * tile_height) {
+        if (tile_atlas)
+            SDL_FreeSurface(tile_atlas);
+
+        tile_atlas = SDL_CreateRGBSurface(0, 2 * tile_width, numItems * tile_height, 16, 0xF800, 0x07E0, 0x001F, 0x0000);
+        if (tile_atlas == NULL) {
+            fprintf(stderr, "Could not create tile atlas - %s\n", SDL_GetError());
+            return;
+        }
     }
 
-    SDL_Color textColor = {255, 255, 255, 0};
+    for (int i = 0; i < numItems; i++) {
+        SDL_Surface *art = app_ids ? boxart_get(app_ids[i], tile_width, tile_height - TILE_BANDS) : NULL;
+        sdl_paint_tile(tile_atlas, (SDL_Rect) {0, i * tile_height, tile_width, tile_height}, false, labels[i], font_size, art);
+        sdl_paint_tile(tile_atlas, (SDL_Rect) {tile_width, i * tile_height, tile_width, tile_height}, true, labels[i], font_size, art);
+        sdl_blit_tile(ctx, i, i == selected);
+    }
 
-    SDL_Surface* textSurface = TTF_RenderText_Blended(font, labels[index], textColor);
-    
-    SDL_Rect textRect;
-    textRect.x = rect.x + (rect.w - textSurface->w) / 2;
-    textRect.y = rect.y + (rect.h - textSurface->h) / 2;
-    textRect.w = textSurface->w;
-    textRect.h = textSurface->h;
+    tile_count = numItems;
+    tile_selected = selected;
+}
 
-    SDL_BlitSurface(textSurface, NULL, surface, &textRect);
-    
-    SDL_FreeSurface(textSurface);
-    TTF_CloseFont(font);
-    TTF_Quit();
+// Moves the selection by copying the two changed tiles from the atlas and
+// uploading only their rectangles
+static void sdl_redraw_selection(SDLContext *ctx, int selected) {
+    if (selected == tile_selected)
+        return;
+
+    SDL_Rect dirty[2];
+    int dirty_count = 0;
+    if (tile_selected >= 0 && tile_selected < tile_count) {
+        sdl_blit_tile(ctx, tile_selected, false);
+        dirty[dirty_count++] = tile_rects[tile_selected];
+    }
+    if (selected >= 0 && selected < tile_count) {
+        sdl_blit_tile(ctx, selected, true);
+        dirty[dirty_count++] = tile_rects[selected];
+    }
+    tile_selected = selected;
+
+    SDL_Surface *surface = ctx->menu_surface;
+    for (int i = 0; i < dirty_count; i++) {
+        Uint8 *pixels = (Uint8 *) surface->pixels + dirty[i].y * surface->pitch + dirty[i].x * surface->format->BytesPerPixel;
+        SDL_UpdateTexture(ctx->menu_texture, &dirty[i], pixels, surface->pitch);
+    }
+
+    SDL_RenderCopy(ctx->renderer, ctx->menu_texture, NULL, NULL);
+    SDL_RenderPresent(ctx->renderer);
 }
 
 void handle_ip_input_space(SDL_Event *event, SDLContext *ctx, int *selected_item);
@@ -494,36 +599,45 @@ void handle_redraw(SDLContext *ctx, int *selected_item, const char *menu_texts[]
         ctx->state.redrawAll = 0;
 
         if (!ctx->state.inSettings && !ctx->state.inIPInput && !ctx->state.inAppMenu) {
-            for (int i = 0; i < 6; ++i) {
-                sdl_tile(ctx, ctx->menu_surface, COLUMNS, ROWS, *selected_item, i, menu_texts, 6, 24, 0);
-            }
+            sdl_draw_tiles(ctx, COLUMNS, ROWS, *selected_item, menu_texts, NULL, 6, 24, 0);
         } else if (ctx->state.inSettings && !ctx->state.inIPInput && !ctx->state.inAppMenu) {
-            for (int i = 0; i < 6; ++i) {
-                sdl_tile(ctx, ctx->menu_surface, COLUMNS, ROWS, *selected_item, i, settings_texts, 6, 24, 0);
-            }
+            sdl_draw_tiles(ctx, COLUMNS, ROWS, *selected_item, settings_texts, NULL, 6, 24, 0);
         } else if (!ctx->state.inSettings && ctx->state.inIPInput && !ctx->state.inAppMenu) {
-            for (int i = 0; i < 15; ++i) {
-                sdl_tile(ctx, ctx->menu_surface, BIG_COL, BIG_ROW, *selected_item, i, ip_input, 15, 24, 0);
-                sdl_draw_textbox(ctx, ctx->menu_surface, ctx->state.entered_ip);
-            }
+            sdl_draw_tiles(ctx, BIG_COL, BIG_ROW, *selected_item, ip_input, NULL, 15, 24, 0);
+            sdl_draw_textbox(ctx, ctx->menu_surface, ctx->state.entered_ip);
         } if (!ctx->state.inSettings && !ctx->state.inIPInput && ctx->state.inAppMenu) {
-                char **app_select = NULL;
-                int count = applist(&server, &app_select);
-                global_app_names = app_select;
-                global_app_count = count;
-
-                if (count > 0) {
-                    for (int i = 0; i < count; ++i) {
-                        sdl_tile(ctx, ctx->menu_surface, COLUMNS, ROWS, *selected_item, i, app_select, count, 16, 1);
-                    }
-                }
+                const APP_CATALOG *apps = app_catalog_acquire(&server);
+                app_catalog_release(shown_apps);
+                shown_apps = apps;
+                shown_apps_generation = apps ? apps->generation : app_catalog_generation();
+                global_app_names = apps ? apps->names : NULL;
+                global_app_count = apps ? apps->count : 0;
+
+                if (*selected_item >= global_app_count)
+                    *selected_item = 0;
+                shown_art_generation = boxart_generation();
+                sdl_draw_tiles(ctx, COLUMNS, ROWS, *selected_item, global_app_names, apps ? apps->ids : NULL, global_app_count, 16, 1);
             }
 
         SDL_UpdateTexture(ctx->menu_texture, NULL, ctx->menu_surface->pixels, ctx->menu_surface->pitch);
         SDL_RenderCopy(ctx->renderer, ctx->menu_texture, NULL, NULL);
         SDL_RenderPresent(ctx->renderer);
 
+        // The list is fetched in the background, SDL_CODE_APPS redraws the
+        // menu once it is there
+        if (ctx->state.inAppMenu && shown_apps == NULL) {
+            if (app_catalog_loading())
+                sdl_banner(ctx, "Loading apps...", "orange");
+            else
+                sdl_banner(ctx, "Can't get the app list", "red");
+        }
+
         ctx->state.redrawAll = 0;
+        ctx->state.redrawSelection = 0;
+        eventPending = 0;
+    } else if (ctx->state.redrawSelection) {
+        sdl_redraw_selection(ctx, *selected_item);
+        ctx->state.redrawSelection = 0;
         eventPending = 0;
     }
 }
@@ -540,19 +654,19 @@ void handle_ip_input(SDL_Event *event, SDLContext *ctx, int *selected_item) {
             break;
         case SDLK_UP:
             *selected_item = (*selected_item - BIG_ROW + MAX_IP_TILES) % MAX_IP_TILES;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_DOWN:
             *selected_item = (*selected_item + BIG_ROW) % MAX_IP_TILES;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_LEFT:
             *selected_item = (*selected_item - 1 + MAX_IP_TILES) % MAX_IP_TILES;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_RIGHT:
             *selected_item = (*selected_item + 1) % MAX_IP_TILES;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         default:
             break;
@@ -562,12 +676,10 @@ void handle_ip_input(SDL_Event *event, SDLContext *ctx, int *selected_item) {
 void handle_app_menu_input(SDL_Event *event, SDLContext *ctx, int *selected_item) {
     switch (event->key.keysym.sym) {
         case SDLK_SPACE:
-            if (*selected_item < global_app_count) {
+            if (*selected_item < global_app_count && !connection_busy(ctx)) {
                 strcpy(config.app, global_app_names[*selected_item]);
                 printf("Selected app: %s\n", global_app_names[*selected_item]);
-                connectRemote(&server, &config, ctx);
-                sdl_banner(ctx, "Host: %s App: %s", "orange", config.address, global_app_names[*selected_item]);
-                handleStreaming(&server, &config);
+                launchApp(ctx);
             }
             break;
         case SDLK_BACKSPACE:
@@ -582,25 +694,25 @@ void handle_app_menu_input(SDL_Event *event, SDLContext *ctx, int *selected_item
         case SDLK_UP:
             if (*selected_item - ctx->state.currentColumns >= 0) {
                 *selected_item -= ctx->state.currentColumns;
-                ctx->state.redrawAll = 1;
+                ctx->state.redrawSelection = 1;
             }
             break;
         case SDLK_DOWN:
             if (*selected_item + ctx->state.currentColumns < global_app_count) {
                 *selected_item += ctx->state.currentColumns;
-                ctx->state.redrawAll = 1;
+                ctx->state.redrawSelection = 1;
             }
             break;
         case SDLK_LEFT:
             if (*selected_item > 0) {
                 *selected_item -= 1;
-                ctx->state.redrawAll = 1;
+                ctx->state.redrawSelection = 1;
             }
             break;
         case SDLK_RIGHT:
             if (*selected_item < global_app_count - 1) {
                 *selected_item += 1;
-                ctx->state.redrawAll = 1;
+                ctx->state.redrawSelection = 1;
             }
             break;
         default:
@@ -647,19 +759,19 @@ void handle_settings_input(SDL_Event *event, SDLContext *ctx, int *selected_item
             break;
         case SDLK_UP:
             *selected_item = (*selected_item - COLUMNS + MAX_ITEMS) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_DOWN:
             *selected_item = (*selected_item + COLUMNS) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_LEFT:
             *selected_item = (*selected_item - 1 + MAX_ITEMS) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_RIGHT:
             *selected_item = (*selected_item + 1) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         default:
             break;
@@ -712,19 +824,19 @@ void handle_main_menu_input(SDL_Event *event, SDLContext *ctx, int *selected_ite
             break;
         case SDLK_UP:
             *selected_item = (*selected_item - COLUMNS + MAX_ITEMS) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_DOWN:
             *selected_item = (*selected_item + COLUMNS) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_LEFT:
             *selected_item = (*selected_item - 1 + MAX_ITEMS) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         case SDLK_RIGHT:
             *selected_item = (*selected_item + 1) % MAX_ITEMS;
-            ctx->state.redrawAll = 1;
+            ctx->state.redrawSelection = 1;
             break;
         default:
             break;
@@ -748,6 +860,10 @@ void handle_backspace_input(SDLContext *ctx) {
 }
 
 void handlePairClient(SDLContext *ctx) {
+    // The running task may still use the address
+    if (connection_busy(ctx))
+        return;
+
     if (ctx->state.entered_ip != NULL) {
         config.address = strdup(ctx->state.entered_ip);
         if (config.address == NULL) {
@@ -784,36 +900,509 @@ int sdl_menu(SDLContext *ctx) {
     const char *ip_input[15] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9", ".", "Exit", "Del", "Clear", "Enter"};
 
     while (1) {
-        while (SDL_PollEvent(&event)) {
+        if (eventPending) {
+            handle_redraw(ctx, &selected_item, menu_texts, settings_texts, ip_input);
+            sdl_startup_deferred(ctx);
+            if (ctx->state.exitNow) {
+                break;
+            }
+        }
+
+        // Sleeps until there is input or background work finished, nothing
+        // in the menu is animated so there is never a frame to wake up for
+        if (!SDL_WaitEventTimeout(&event, -1))
+            continue;
+
+        do {
             if (event.type == SDL_QUIT) {
                 return 1;
             }
             if (event.type == SDL_KEYDOWN) {
+                // Escape abandons a running gamestream task first
+                if (event.key.keysym.sym == SDLK_ESCAPE && connection_cancel(ctx))
+                    continue;
+
                 eventPending = 1;
                 handle_key_input(&event, ctx, &selected_item, menu_texts, settings_texts, ip_input);
+            } else if (event.type == SDL_USEREVENT && event.user.code == SDL_CODE_TASK) {
+                task_dispatch();
+            } else if (event.type == SDL_USEREVENT && (event.user.code == SDL_CODE_APPS || event.user.code == SDL_CODE_BOXART)) {
+                // Stale when the list or art was already drawn
+                if (ctx->state.inAppMenu && (app_catalog_generation() != shown_apps_generation || boxart_generation() != shown_art_generation)) {
+                    ctx->state.redrawAll = 1;
+                    eventPending = 1;
+                }
             }
+        } while (SDL_PollEvent(&event));
+    }
+
+    return 0;
+}
+
+static int video_width, video_height, texture_width, texture_height;
+static Uint32 upload_format, texture_format;
+static bool contiguous_upload;
+static SDL_Rect frame_rect, video_rect;
+
+// Video texture formats negotiated when SDL scales, in order of
+// preference when their costs tie
+static const Uint32 upload_formats[] = {SDL_PIXELFORMAT_YV12, SDL_PIXELFORMAT_IYUV, SDL_PIXELFORMAT_NV12, SDL_PIXELFORMAT_RGB565};
+#define UPLOAD_FORMATS (sizeof(upload_formats) / sizeof(upload_formats[0]))
+
+// Estimated costs within this many percent of the cheapest are decided by
+// the upload times measured at startup
+#define UPLOAD_TIE_PERCENT 25
+#define UPLOAD_BENCHMARK_FRAMES 4
+
+// Relative cost per pixel of our NEON conversion and of SDL's software
+// YUV emulation, compared to copying a byte
+#define CONVERT_COST 4
+#define EMULATION_COST 8
+
+// Texture upload timings of the stream, what the single copy of contiguous
+// frames saves over uploading plane by plane shows in the calibration
+#define UPLOAD_CONTIGUOUS 0
+#define UPLOAD_PLANAR 1
+#define UPLOAD_INTERLEAVED 2
+#define UPLOAD_CONVERTED 3
+#define UPLOAD_PATHS 4
+static uint64_t upload_count[UPLOAD_PATHS], upload_ticks[UPLOAD_PATHS];
+
+// Measured once at startup on a blank frame of the configured stream size,
+// so picking the format when the stream starts needs no trial uploads on
+// the render thread. Microseconds per megapixel, 0 when not measured.
+static double calibrated_us[UPLOAD_FORMATS][UPLOAD_PATHS];
+
+static bool sdl_native_format(Uint32 format) {
+    for (int i = 0; i < renderer_format_count; i++) {
+        if (renderer_formats[i] == format)
+            return true;
+    }
+    return false;
+}
+
+static bool sdl_planar_frame(AVFrame *frame) {
+    return frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P;
+}
+
+// Rough cost of converting and uploading a frame in bytes touched, or -1
+// when frames of this pixel format can't be uploaded in the format
+static int64_t sdl_upload_cost(Uint32 format, AVFrame *frame) {
+    int64_t frame_pixels = (int64_t) frame->width * frame->height;
+    int64_t video_pixels = (int64_t) video_rect.w * video_rect.h;
+    int64_t cost;
+
+    switch (format) {
+    case SDL_PIXELFORMAT_YV12:
+    case SDL_PIXELFORMAT_IYUV:
+        if (!sdl_planar_frame(frame))
+            return -1;
+        cost = frame_pixels * 3 / 2;
+        break;
+    case SDL_PIXELFORMAT_NV12:
+        if (frame->format == AV_PIX_FMT_NV12)
+            cost = frame_pixels * 3 / 2;
+        else if (sdl_planar_frame(frame))
+            cost = frame_pixels * 2;
+        else
+            return -1;
+        break;
+    case SDL_PIXELFORMAT_RGB565:
+        if (!rgb565_ready || (!sdl_planar_frame(frame) && frame->format != AV_PIX_FMT_NV12))
+            return -1;
+        // Converted straight to the displayed size, so SDL doesn't scale at all
+        return video_pixels * (CONVERT_COST + 2);
+    default:
+        return -1;
+    }
+
+    if (!sdl_native_format(format))
+        cost += frame_pixels * EMULATION_COST;
+
+    return cost;
+}
+
+// Size of the texture frames are uploaded to, SDL scales YUV textures of
+// the stream size, RGB565 is converted straight to the displayed size
+static void sdl_texture_size(Uint32 format, AVFrame *frame, int *width, int *height) {
+    contiguous_upload = false;
+    if (format == SDL_PIXELFORMAT_RGB565) {
+        *width = video_rect.w;
+        *height = video_rect.h;
+        frame_rect = (SDL_Rect) {0, 0, *width, *height};
+        return;
+    }
+
+    // Contiguous frames are uploaded as a whole, including the decoder's padding
+    int contiguous_height = format == SDL_PIXELFORMAT_YV12 ? ffmpeg_contiguous_height(frame) : 0;
+    contiguous_upload = contiguous_height > 0;
+    *width = contiguous_upload ? frame->linesize[0] : frame->width;
+    *height = contiguous_upload ? contiguous_height : frame->height;
+    frame_rect = (SDL_Rect) {0, 0, frame->width, frame->height};
+}
+
+static bool sdl_create_texture(SDLContext *ctx, Uint32 format, int width, int height) {
+    if (ctx->bmp && format == texture_format && width == texture_width && height == texture_height)
+        return true;
+
+    if (ctx->bmp)
+        SDL_DestroyTexture(ctx->bmp);
+
+    ctx->bmp = SDL_CreateTexture(ctx->renderer, format, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!ctx->bmp) {
+        fprintf(stderr, "SDL: could not create texture - %s\n", SDL_GetError());
+        texture_width = texture_height = 0;
+        return false;
+    }
+
+    texture_format = format;
+    texture_width = width;
+    texture_height = height;
+    return true;
+}
+
+static bool sdl_upload_nv12(SDLContext *ctx, AVFrame *frame) {
+    Uint8 *pixels;
+    int pitch;
+    if (SDL_LockTexture(ctx->bmp, NULL, (void **) &pixels, &pitch) != 0) {
+        fprintf(stderr, "Couldn't lock texture - %s\n", SDL_GetError());
+        return false;
+    }
+
+    for (int y = 0; y < frame->height; y++)
+        memcpy(pixels + y * pitch, frame->data[0] + y * frame->linesize[0], frame->width);
+
+    // The interleaved chroma plane follows the luma plane with the same pitch
+    Uint8 *chroma = pixels + pitch * texture_height;
+    for (int y = 0; y < (frame->height + 1) / 2; y++) {
+        Uint8 *dst = chroma + y * pitch;
+        if (frame->format == AV_PIX_FMT_NV12) {
+            memcpy(dst, frame->data[1] + y * frame->linesize[1], frame->width);
+            continue;
         }
 
-        if (eventPending) {
-            handle_redraw(ctx, &selected_item, menu_texts, settings_texts, ip_input);
-            if (ctx->state.exitNow) {
-                break;
-            }
+        const Uint8 *u = frame->data[1] + y * frame->linesize[1];
+        const Uint8 *v = frame->data[2] + y * frame->linesize[2];
+        for (int x = 0; x < (frame->width + 1) / 2; x++) {
+            dst[2 * x] = u[x];
+            dst[2 * x + 1] = v[x];
         }
+    }
 
-        SDL_Delay(25);
+    SDL_UnlockTexture(ctx->bmp);
+    return true;
+}
+
+static bool sdl_upload_rgb565(SDLContext *ctx, AVFrame *frame) {
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(ctx->bmp, NULL, &pixels, &pitch) != 0) {
+        fprintf(stderr, "Couldn't lock texture - %s\n", SDL_GetError());
+        return false;
     }
 
-    return 0;
+    bool converted = yuv2rgb565_convert_frame(frame, pixels, pitch, video_rect.w, video_rect.h) == 0;
+    if (!converted)
+        fprintf(stderr, "Unsupported frame format %d\n", frame->format);
+
+    SDL_UnlockTexture(ctx->bmp);
+    return converted;
+}
+
+static bool sdl_upload_frame(SDLContext *ctx, AVFrame *frame, int path) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    bool uploaded = true;
+    switch (path) {
+    case UPLOAD_CONTIGUOUS:
+        SDL_UpdateTexture(ctx->bmp, NULL, frame->data[0], frame->linesize[0]);
+        break;
+    case UPLOAD_PLANAR:
+        // SDL takes the planes in Y, U, V order for both YV12 and IYUV
+        SDL_UpdateYUVTexture(ctx->bmp, &frame_rect, frame->data[0], frame->linesize[0], frame->data[1], frame->linesize[1], frame->data[2], frame->linesize[2]);
+        break;
+    case UPLOAD_INTERLEAVED:
+        uploaded = sdl_upload_nv12(ctx, frame);
+        break;
+    case UPLOAD_CONVERTED:
+        uploaded = sdl_upload_rgb565(ctx, frame);
+        break;
+    }
+
+    upload_ticks[path] += SDL_GetPerformanceCounter() - start;
+    upload_count[path]++;
+    return uploaded;
+}
+
+static int sdl_upload_path(Uint32 format) {
+    switch (format) {
+    case SDL_PIXELFORMAT_RGB565:
+        return UPLOAD_CONVERTED;
+    case SDL_PIXELFORMAT_NV12:
+        return UPLOAD_INTERLEAVED;
+    default:
+        // Only YV12 textures match the layout of contiguous frames
+        return contiguous_upload && format == SDL_PIXELFORMAT_YV12 ? UPLOAD_CONTIGUOUS : UPLOAD_PLANAR;
+    }
+}
+
+// Average time to upload the frame in a format, or 0 when it failed
+static double sdl_benchmark_format(SDLContext *ctx, Uint32 format, AVFrame *frame, int path) {
+    int width, height;
+    sdl_texture_size(format, frame, &width, &height);
+    if (!sdl_create_texture(ctx, format, width, height))
+        return 0;
+
+    uint64_t count = upload_count[path], ticks = upload_ticks[path];
+
+    // The first upload may allocate, only time the following ones
+    bool uploaded = sdl_upload_frame(ctx, frame, path);
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; uploaded && i < UPLOAD_BENCHMARK_FRAMES; i++)
+        uploaded = sdl_upload_frame(ctx, frame, path);
+    Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+
+    // Benchmark uploads don't count towards the stream's statistics
+    upload_count[path] = count;
+    upload_ticks[path] = ticks;
+
+    if (!uploaded)
+        return 0;
+
+    return elapsed * 1000000.0 / SDL_GetPerformanceFrequency() / UPLOAD_BENCHMARK_FRAMES;
+}
+
+// Keep the aspect ratio of the stream and center it on the panel
+static void sdl_fit_video(SDLContext *ctx, int width, int height) {
+    int output_width, output_height;
+    if (SDL_GetRendererOutputSize(ctx->renderer, &output_width, &output_height) != 0) {
+        output_width = PANEL_WIDTH;
+        output_height = PANEL_HEIGHT;
+    }
+
+    if (width * output_height > height * output_width) {
+        video_rect.w = output_width;
+        video_rect.h = output_width * height / width;
+    } else {
+        video_rect.w = output_height * width / height;
+        video_rect.h = output_height;
+    }
+    video_rect.x = (output_width - video_rect.w) / 2;
+    video_rect.y = (output_height - video_rect.h) / 2;
+}
+
+// Pixels a path touches per upload, converting works at the displayed size
+static int64_t sdl_upload_pixels(int path, AVFrame *frame) {
+    if (path == UPLOAD_CONVERTED)
+        return (int64_t) video_rect.w * video_rect.h;
+
+    return (int64_t) frame->width * frame->height;
+}
+
+// Times every format and path on a blank planar frame laid out like the
+// decoder's contiguous frames. Runs on the UI thread, which renders the
+// stream as well, before any stream connects.
+static void sdl_calibrate_uploads(SDLContext *ctx) {
+    if (config.scaler != SCALER_SDL)
+        return;
+
+    int width = config.stream.width & ~1, height = config.stream.height & ~1;
+    if (width <= 0 || height <= 0)
+        return;
+
+    int luma_size = width * height, chroma_size = luma_size / 4;
+    AVFrame *frame = av_frame_alloc();
+    AVBufferRef *buffer = av_buffer_allocz(luma_size + 2 * chroma_size);
+    if (frame == NULL || buffer == NULL) {
+        av_buffer_unref(&buffer);
+        av_frame_free(&frame);
+        return;
+    }
+
+    // Same layout as a YV12 texture, Y then V then U
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    frame->buf[0] = buffer;
+    frame->data[0] = buffer->data;
+    frame->data[2] = frame->data[0] + luma_size;
+    frame->data[1] = frame->data[2] + chroma_size;
+    frame->linesize[0] = width;
+    frame->linesize[1] = frame->linesize[2] = width / 2;
+
+    sdl_fit_video(ctx, width, height);
+
+    static const char* names[UPLOAD_PATHS] = {"contiguous", "per plane", "interleaved", "converted"};
+    for (size_t i = 0; i < UPLOAD_FORMATS; i++) {
+        Uint32 format = upload_formats[i];
+        if (sdl_upload_cost(format, frame) < 0)
+            continue;
+
+        // YV12 is measured both as a whole and plane by plane, which one is
+        // used depends on the decoder's frames
+        int paths[2], path_count = 0;
+        if (format == SDL_PIXELFORMAT_YV12) {
+            paths[path_count++] = UPLOAD_CONTIGUOUS;
+            paths[path_count++] = UPLOAD_PLANAR;
+        } else
+            paths[path_count++] = sdl_upload_path(format);
+
+        for (int j = 0; j < path_count; j++) {
+            int path = paths[j];
+            double us = sdl_benchmark_format(ctx, format, frame, path);
+            if (us <= 0)
+                continue;
+
+            calibrated_us[i][path] = us * 1000000.0 / sdl_upload_pixels(path, frame);
+            printf("Texture upload %s %s: %.1f us for %dx%d\n", SDL_GetPixelFormatName(format), names[path], us, width, height);
+        }
+    }
+
+    // The stream creates its own texture once its size is known
+    if (ctx->bmp)
+        SDL_DestroyTexture(ctx->bmp);
+    ctx->bmp = NULL;
+    texture_width = texture_height = 0;
+
+    av_frame_free(&frame);
+}
+
+// Picks the format with the cheapest estimated conversion and upload,
+// candidates within UPLOAD_TIE_PERCENT are decided by the upload times
+// measured at startup
+static Uint32 sdl_negotiate_format(AVFrame *frame) {
+    int64_t costs[UPLOAD_FORMATS];
+    int64_t cheapest = -1;
+    for (size_t i = 0; i < UPLOAD_FORMATS; i++) {
+        costs[i] = sdl_upload_cost(upload_formats[i], frame);
+        if (costs[i] >= 0 && (cheapest < 0 || costs[i] < cheapest))
+            cheapest = costs[i];
+    }
+
+    // Nothing fits the decoder's output, leave any conversion to SDL
+    if (cheapest < 0)
+        return SDL_PIXELFORMAT_YV12;
+
+    Uint32 best = SDL_PIXELFORMAT_UNKNOWN, estimated = SDL_PIXELFORMAT_UNKNOWN;
+    double best_us = 0;
+    for (size_t i = 0; i < UPLOAD_FORMATS; i++) {
+        Uint32 format = upload_formats[i];
+        const char *native = sdl_native_format(format) ? "native" : "emulated";
+        if (costs[i] < 0) {
+            printf("Texture format %s: unsupported for %s frames\n", SDL_GetPixelFormatName(format), av_get_pix_fmt_name(frame->format));
+            continue;
+        }
+
+        if (costs[i] == cheapest && estimated == SDL_PIXELFORMAT_UNKNOWN)
+            estimated = format;
+
+        if (costs[i] * 100 > cheapest * (100 + UPLOAD_TIE_PERCENT)) {
+            printf("Texture format %s: %s, estimated cost %lld\n", SDL_GetPixelFormatName(format), native, (long long) costs[i]);
+            continue;
+        }
+
+        int width, height;
+        sdl_texture_size(format, frame, &width, &height);
+        int path = sdl_upload_path(format);
+        double us = calibrated_us[i][path] * sdl_upload_pixels(path, frame) / 1000000.0;
+        if (us <= 0) {
+            printf("Texture format %s: %s, estimated cost %lld\n", SDL_GetPixelFormatName(format), native, (long long) costs[i]);
+            continue;
+        }
+
+        printf("Texture format %s: %s, estimated cost %lld, about %.1f us per upload\n", SDL_GetPixelFormatName(format), native, (long long) costs[i], us);
+        if (best == SDL_PIXELFORMAT_UNKNOWN || us < best_us) {
+            best = format;
+            best_us = us;
+        }
+    }
+
+    // Without measurements the estimate decides
+    if (best == SDL_PIXELFORMAT_UNKNOWN)
+        best = estimated;
+
+    printf("Uploading %s video as %s\n", av_get_pix_fmt_name(frame->format), SDL_GetPixelFormatName(best));
+    return best;
+}
+
+static bool sdl_prepare_texture(SDLContext *ctx, AVFrame *frame) {
+    bool negotiate = false;
+    if (frame->width != video_width || frame->height != video_height) {
+        sdl_fit_video(ctx, frame->width, frame->height);
+
+        video_width = frame->width;
+        video_height = frame->height;
+        printf("Video %dx%d displayed at %dx%d\n", video_width, video_height, video_rect.w, video_rect.h);
+        negotiate = true;
+    }
+
+    // Our own scaler always converts to RGB565, with SDL scaling the format is negotiated
+    if (config.scaler != SCALER_SDL)
+        upload_format = SDL_PIXELFORMAT_RGB565;
+    else if (negotiate || upload_format == SDL_PIXELFORMAT_UNKNOWN)
+        upload_format = sdl_negotiate_format(frame);
+
+    int width, height;
+    sdl_texture_size(upload_format, frame, &width, &height);
+    return sdl_create_texture(ctx, upload_format, width, height);
+}
+
+static bool sdl_update_frame(SDLContext *ctx, AVFrame *frame) {
+    if (!sdl_prepare_texture(ctx, frame))
+        return false;
+
+    return sdl_upload_frame(ctx, frame, sdl_upload_path(texture_format));
+}
+
+static void sdl_print_upload_stats(void) {
+    static const char* names[UPLOAD_PATHS] = {"contiguous", "per plane", "interleaved", "converted"};
+    double frequency = SDL_GetPerformanceFrequency();
+    for (int i = 0; i < UPLOAD_PATHS; i++) {
+        if (upload_count[i] > 0)
+            printf("Texture upload %s: %llu frames, %.1f us average\n", names[i], (unsigned long long) upload_count[i], upload_ticks[i] * 1000000.0 / frequency / upload_count[i]);
+    }
+}
+
+static void sdl_present_frame(SDLContext *ctx) {
+    AVFrame* frame = pacing_next_frame();
+    uint64_t start = latency_now_us();
+    if (frame != NULL && sdl_update_frame(ctx, frame)) {
+        latency_record_since(LATENCY_UPLOAD, start);
+        SDL_RenderClear(ctx->renderer);
+        SDL_RenderCopy(ctx->renderer, ctx->bmp, &frame_rect, &video_rect);
+        overlay_draw(ctx);
+        start = latency_now_us();
+        SDL_RenderPresent(ctx->renderer);
+        latency_record_since(LATENCY_PRESENT, start);
+        pacing_presented();
+        if (frame->pts != AV_NOPTS_VALUE)
+            latency_record_host(LATENCY_END_TO_END, frame->pts);
+    }
 }
 
 void sdl_loop(SDLContext *ctx) {
     SDL_Event event;
     SDL_SetRelativeMouseMode(SDL_TRUE);
     done = 0;
+    overlay_init(config.overlay);
     // printf("Entered Loop\n");
 
-    while(!done && SDL_WaitEvent(&event)) {
+    // Present the newest frame as soon as it's decoded, at the cost of tearing
+    if (config.pacing == PACING_LOWEST_LATENCY) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        if (SDL_RenderSetVSync(ctx->renderer, 0) != 0)
+            fprintf(stderr, "Couldn't disable vsync - %s\n", SDL_GetError());
+#else
+        fprintf(stderr, "Disabling vsync requires SDL 2.0.18\n");
+#endif
+    }
+
+    while(!done) {
+        // Frames the pacing policy held back become due without an event
+        if (!SDL_WaitEventTimeout(&event, pacing_timeout())) {
+            sdl_present_frame(ctx);
+            continue;
+        }
+
         if (ctx->state.exitNow == 1) {
             done = true;
             break;
@@ -827,6 +1416,9 @@ void sdl_loop(SDLContext *ctx) {
               fullscreen_flags ^= SDL_WINDOW_FULLSCREEN;
               SDL_SetWindowFullscreen(ctx->window, fullscreen_flags);
               break;
+        case SDL_TOGGLE_OVERLAY:
+              overlay_toggle();
+              break;
         case SDL_MOUSE_GRAB:
               SDL_ShowCursor(SDL_ENABLE);
               SDL_SetRelativeMouseMode(SDL_TRUE);
@@ -839,27 +1431,17 @@ void sdl_loop(SDLContext *ctx) {
           if (event.type == SDL_QUIT)
                 done = true;
           else if (event.type == SDL_USEREVENT) {
-                if (event.user.code == SDL_CODE_FRAME) {
-                if (++sdlCurrentFrame <= sdlNextFrame - SDL_BUFFER_FRAMES) {
-                    //Skip frame
-                } else if (SDL_LockMutex(mutex) == 0) {
-                    Uint8** data = ((Uint8**) event.user.data1);
-                    int* linesize = ((int*) event.user.data2);
-                    SDL_UpdateYUVTexture(ctx->bmp, NULL, data[0], linesize[0], data[1], linesize[1], data[2], linesize[2]);
-                    SDL_UnlockMutex(mutex);
-                    SDL_RenderClear(ctx->renderer);
-                    SDL_RenderCopy(ctx->renderer, ctx->bmp, NULL, NULL);
-                    SDL_RenderPresent(ctx->renderer);
-                } else
-                    fprintf(stderr, "Couldn't lock mutex\n");
-                }
+                if (event.user.code == SDL_CODE_FRAME)
+                    sdl_present_frame(ctx);
           }
         }
     }
 
     // quitRemote(&server, &config, ctx);
     printf("EXIT LOOP\n");
-    cleanupSDLContext(ctx);
+    sdl_print_upload_stats();
+    pacing_print_stats();
+    overlay_destroy();
 }
 
 #endif /* HAVE_SDL */
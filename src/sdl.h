@@ -34,14 +34,24 @@
 #define SDL_MOUSE_GRAB 2
 #define SDL_MOUSE_UNGRAB 3
 #define SDL_TOGGLE_FULLSCREEN 4
+#define SDL_TOGGLE_OVERLAY 5
 
 #define SDL_CODE_FRAME 0
+// Background work finished, the menu redraws when it shows the result
+#define SDL_CODE_APPS 1
+#define SDL_CODE_BOXART 2
+#define SDL_CODE_TASK 3
 
-#define SDL_BUFFER_FRAMES 2
+// Longest banner message
+#define SDL_BANNER_LENGTH 256
 
-#define SPLASH_PATH "/mnt/SDCARD/App/moonlight/res/splash"
+#define PANEL_WIDTH 640
+#define PANEL_HEIGHT 480
+
+#define SPLASH_PACK "/mnt/SDCARD/App/moonlight/res/splash.pack"
 #define MIYOO_VERSION "1.3"
 #define TOP_BANNER "/mnt/SDCARD/App/moonlight/res/icon/top_banner.png"
+#define UI_BUNDLE "/mnt/SDCARD/App/moonlight/res/ui.bundle"
 #define MOONLIGHT_FONT "/mnt/SDCARD/miyoo/app/Helvetica-Neue-2.ttf"
 #define MOONLIGHT_DIR "/mnt/SDCARD/App/moonlight"
 
@@ -57,6 +67,7 @@
 typedef struct {
     int redraw;
     int redrawAll;
+    int redrawSelection;
     int inSettings;
     int inIPInput;
     int noPairStart;
@@ -78,7 +89,6 @@ typedef struct SDLContext {
     SDL_Texture *menu_texture;
     SDL_Surface* cached_top_banner;
     TTF_Font *font;
-    int sdlCurrentFrame, sdlNextFrame;
     bool fullscreen;
     UIState state;
 } SDLContext;
@@ -94,9 +104,6 @@ void sdl_loop(SDLContext *ctx);
 void sdl_splash(SDLContext *ctx);
 void cleanupSDLContext(SDLContext *ctx);
 
-extern SDL_mutex *mutex;
-extern int sdlCurrentFrame, sdlNextFrame;
-
 #endif /* HAVE_SDL */
 
 #endif /* MOONLIGHT_SDL_HEADER_H */
\ No newline at end of file
@@ -0,0 +1,104 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "startup.h"
+#include "latency.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define STARTUP_MAX_PHASES 32
+
+typedef struct _STARTUP_PHASE {
+  const char* name;
+  uint64_t start_us;
+  uint64_t end_us;
+  long thread;
+} STARTUP_PHASE;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static STARTUP_PHASE phases[STARTUP_MAX_PHASES];
+static int phase_count;
+static uint64_t origin_us, interactive_us;
+static long main_thread;
+
+void startup_init(void) {
+  origin_us = latency_now_us();
+  main_thread = syscall(SYS_gettid);
+}
+
+int startup_begin(const char* name) {
+  int phase = -1;
+
+  pthread_mutex_lock(&mutex);
+  if (phase_count < STARTUP_MAX_PHASES) {
+    phase = phase_count++;
+    phases[phase] = (STARTUP_PHASE) {name, latency_now_us(), 0, syscall(SYS_gettid)};
+  }
+  pthread_mutex_unlock(&mutex);
+
+  return phase;
+}
+
+void startup_end(int phase) {
+  if (phase < 0)
+    return;
+
+  pthread_mutex_lock(&mutex);
+  phases[phase].end_us = latency_now_us();
+  pthread_mutex_unlock(&mutex);
+}
+
+void startup_interactive(void) {
+  pthread_mutex_lock(&mutex);
+  if (interactive_us == 0)
+    interactive_us = latency_now_us();
+  pthread_mutex_unlock(&mutex);
+}
+
+void startup_write(void) {
+  FILE* log = fopen(STARTUP_LOG, "w");
+  if (log == NULL) {
+    perror(STARTUP_LOG);
+    return;
+  }
+
+  pthread_mutex_lock(&mutex);
+  fprintf(log, "# Times in ms since main, phases on the main thread are marked with *\n");
+  fprintf(log, "%8s %8s %8s  %s\n", "start", "end", "duration", "phase");
+  for (int i = 0; i < phase_count; i++) {
+    const STARTUP_PHASE* phase = &phases[i];
+    double start = (phase->start_us - origin_us) / 1000.0;
+    char marker = phase->thread == main_thread ? '*' : ' ';
+    if (phase->end_us == 0) {
+      fprintf(log, "%8.1f %8s %8s %c%s\n", start, "-", "running", marker, phase->name);
+    } else {
+      double end = (phase->end_us - origin_us) / 1000.0;
+      fprintf(log, "%8.1f %8.1f %8.1f %c%s\n", start, end, end - start, marker, phase->name);
+    }
+  }
+
+  double interactive = interactive_us ? (interactive_us - origin_us) / 1000.0 : 0;
+  fprintf(log, "Interactive after %.1f ms\n", interactive);
+  pthread_mutex_unlock(&mutex);
+
+  fclose(log);
+  printf("Startup: interactive after %.1f ms, trace written to %s\n", interactive, STARTUP_LOG);
+}
@@ -0,0 +1,36 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+// Written on every start to track time to interactive across releases
+#define STARTUP_LOG "/mnt/SDCARD/App/moonlight/startup.log"
+
+// Starts the clock of the trace, call first thing in main
+void startup_init(void);
+
+// Phases are timed from begin to end, safe to call from any thread.
+// Returns a handle for startup_end, or -1 when the trace is full.
+int startup_begin(const char* phase);
+void startup_end(int phase);
+
+// Marks the first menu frame presented, the time to interactive
+void startup_interactive(void);
+// Writes the trace to STARTUP_LOG, phases still running are marked so
+void startup_write(void);
@@ -0,0 +1,184 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_SDL
+
+#include "task.h"
+#include "sdl.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Requests serialize on connection_lock, a second worker keeps a request
+// from waiting behind one that was cancelled but still runs
+#define TASK_WORKERS 2
+
+// Progress message, or the end of the task when text is NULL
+typedef struct _TASK_MESSAGE {
+    PTASK task;
+    char *text;
+    struct _TASK_MESSAGE *next;
+} TASK_MESSAGE;
+
+struct _TASK {
+    const char *name;
+    TaskRun run;
+    TaskProgress progress;
+    TaskDone done;
+    void *data;
+    int result;
+    bool cancelled;
+    PTASK next;
+    // Allocated with the task so the end can't be lost
+    TASK_MESSAGE end;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static PTASK pending, pending_tail;
+static TASK_MESSAGE *messages, *messages_tail;
+static bool started;
+
+// Messages stay queued when the wake up can't be pushed, like before SDL
+// is initialized, task_dispatch finds them the next time it runs
+static void task_post(TASK_MESSAGE *message) {
+    pthread_mutex_lock(&mutex);
+    if (messages_tail)
+        messages_tail->next = message;
+    else
+        messages = message;
+    messages_tail = message;
+    pthread_mutex_unlock(&mutex);
+
+    SDL_Event event = {0};
+    event.type = SDL_USEREVENT;
+    event.user.code = SDL_CODE_TASK;
+    SDL_PushEvent(&event);
+}
+
+static void *task_worker(void *arg) {
+    while (true) {
+        pthread_mutex_lock(&mutex);
+        while (pending == NULL)
+            pthread_cond_wait(&cond, &mutex);
+
+        PTASK task = pending;
+        pending = task->next;
+        if (pending == NULL)
+            pending_tail = NULL;
+        pthread_mutex_unlock(&mutex);
+
+        if (!task_cancelled(task))
+            task->result = task->run(task, task->data);
+
+        task->end = (TASK_MESSAGE) {task, NULL, NULL};
+        task_post(&task->end);
+    }
+
+    return NULL;
+}
+
+void task_init(void) {
+    if (started)
+        return;
+
+    started = true;
+    for (int i = 0; i < TASK_WORKERS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, task_worker, NULL) != 0) {
+            fprintf(stderr, "Can't start task worker\n");
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+PTASK task_submit(const char *name, TaskRun run, TaskProgress progress, TaskDone done, void *data) {
+    PTASK task = calloc(1, sizeof(TASK));
+    if (task == NULL)
+        return NULL;
+
+    task->name = name;
+    task->run = run;
+    task->progress = progress;
+    task->done = done;
+    task->data = data;
+    pthread_mutex_lock(&mutex);
+    if (pending_tail)
+        pending_tail->next = task;
+    else
+        pending = task;
+    pending_tail = task;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+
+    return task;
+}
+
+void task_cancel(PTASK task) {
+    printf("Cancelled %s\n", task->name);
+    __atomic_store_n(&task->cancelled, true, __ATOMIC_RELEASE);
+}
+
+bool task_cancelled(PTASK task) {
+    return __atomic_load_n(&task->cancelled, __ATOMIC_ACQUIRE);
+}
+
+void task_progress(PTASK task, const char *format, ...) {
+    // Text stored behind the message, a progress message lost to low memory
+    // is harmless
+    TASK_MESSAGE *message = malloc(sizeof(TASK_MESSAGE) + SDL_BANNER_LENGTH);
+    if (message == NULL)
+        return;
+
+    *message = (TASK_MESSAGE) {task, (char *) (message + 1), NULL};
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message->text, SDL_BANNER_LENGTH, format, args);
+    va_end(args);
+
+    task_post(message);
+}
+
+void task_dispatch(void) {
+    pthread_mutex_lock(&mutex);
+    TASK_MESSAGE *message = messages;
+    messages = messages_tail = NULL;
+    pthread_mutex_unlock(&mutex);
+
+    while (message) {
+        TASK_MESSAGE *next = message->next;
+        PTASK task = message->task;
+        bool cancelled = task_cancelled(task);
+        if (message->text) {
+            if (!cancelled && task->progress)
+                task->progress(message->text, task->data);
+            free(message);
+        } else {
+            // The end message is part of the task
+            task->done(task->result, cancelled, task->data);
+            free(task);
+        }
+
+        message = next;
+    }
+}
+
+#endif /* HAVE_SDL */
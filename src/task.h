@@ -0,0 +1,52 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_SDL
+
+#include <stdbool.h>
+
+typedef struct _TASK TASK, *PTASK;
+
+// Runs on a worker thread, the result is handed to the done callback
+typedef int (*TaskRun)(PTASK task, void *data);
+// Run on the UI thread by task_dispatch, so they may draw
+typedef void (*TaskProgress)(const char *message, void *data);
+typedef void (*TaskDone)(int result, bool cancelled, void *data);
+
+// Blocking gamestream requests run on a small pool of workers. Progress
+// messages and results are queued for the UI thread, which is woken up
+// with a SDL_CODE_TASK user event and runs the callbacks in task_dispatch.
+void task_init(void);
+
+// Returns NULL when out of memory. progress may be NULL, done always runs
+// and owns data.
+PTASK task_submit(const char *name, TaskRun run, TaskProgress progress, TaskDone done, void *data);
+
+// A running request can't be interrupted, its progress is dropped and done
+// runs with cancelled set once it returns. Only call before done ran.
+void task_cancel(PTASK task);
+
+// For workers, to skip the remaining steps of a cancelled task
+bool task_cancelled(PTASK task);
+void task_progress(PTASK task, const char *format, ...);
+
+// Runs the callbacks of queued progress and finished tasks, UI thread only
+void task_dispatch(void);
+
+#endif /* HAVE_SDL */
@@ -0,0 +1,290 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_SDL
+
+#include "text_cache.h"
+#include "ui_bundle.h"
+#include "sdl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXT_CACHE_FONTS 8
+#define TEXT_CACHE_LABELS 64
+// Rendered labels are 32 bit surfaces, a menu tile label is about 30 KB
+#define TEXT_CACHE_BYTES (2 * 1024 * 1024)
+
+typedef struct _TEXT_CACHE_FONT {
+    int size;
+    TTF_Font *font;
+} TEXT_CACHE_FONT;
+
+typedef struct _TEXT_CACHE_LABEL {
+    char *text;
+    int size;
+    Uint32 color;
+    SDL_Surface *surface;
+    size_t bytes;
+    uint64_t last_used;
+} TEXT_CACHE_LABEL;
+
+static SDL_mutex *mutex;
+static TEXT_CACHE_FONT fonts[TEXT_CACHE_FONTS];
+static int font_count;
+static TEXT_CACHE_LABEL labels[TEXT_CACHE_LABELS];
+static size_t label_bytes;
+static uint64_t use_counter;
+static TEXT_CACHE_STATS stats;
+
+void text_cache_init(void) {
+    if (mutex == NULL)
+        mutex = SDL_CreateMutex();
+}
+
+static void text_cache_evict(TEXT_CACHE_LABEL *label) {
+    label_bytes -= label->bytes;
+    SDL_FreeSurface(label->surface);
+    free(label->text);
+    memset(label, 0, sizeof(*label));
+}
+
+void text_cache_destroy(void) {
+    if (mutex == NULL)
+        return;
+
+    SDL_LockMutex(mutex);
+    printf("Text cache: %d fonts opened, %llu labels rendered, %llu reused, %llu evicted\n", (int) stats.font_opens,
+           (unsigned long long) stats.misses, (unsigned long long) stats.hits, (unsigned long long) stats.evictions);
+
+    for (int i = 0; i < TEXT_CACHE_LABELS; i++) {
+        if (labels[i].surface)
+            text_cache_evict(&labels[i]);
+    }
+
+    for (int i = 0; i < font_count; i++)
+        TTF_CloseFont(fonts[i].font);
+
+    font_count = 0;
+    SDL_UnlockMutex(mutex);
+}
+
+static TTF_Font *text_cache_find_font(int size) {
+    for (int i = 0; i < font_count; i++) {
+        if (fonts[i].size == size)
+            return fonts[i].font;
+    }
+
+    if (font_count == TEXT_CACHE_FONTS) {
+        fprintf(stderr, "Too many font sizes, can't load size %d\n", size);
+        return NULL;
+    }
+
+    TTF_Font *font = TTF_OpenFont(MOONLIGHT_FONT, size);
+    if (font == NULL) {
+        fprintf(stderr, "Could not load font: %s\n", TTF_GetError());
+        return NULL;
+    }
+
+    stats.font_opens++;
+    fonts[font_count++] = (TEXT_CACHE_FONT) {size, font};
+    return font;
+}
+
+static const UI_BUNDLE_GLYPH *text_cache_glyph(const UI_BUNDLE_FONT *font, unsigned char c) {
+    if (c < UI_BUNDLE_FIRST_GLYPH)
+        c = '?';
+
+    return &font->header->glyphs[c - UI_BUNDLE_FIRST_GLYPH];
+}
+
+// Coverage of a label drawn from a bundled glyph atlas as an 8 bit surface
+// of the size TTF would render it, the caller turns it into colors
+static SDL_Surface *text_cache_rasterize(const UI_BUNDLE_FONT *font, const char *text) {
+    int width = 0, pen = 0;
+    for (const unsigned char *c = (const unsigned char *) text; *c; c++) {
+        const UI_BUNDLE_GLYPH *glyph = text_cache_glyph(font, *c);
+        width = SDL_max(width, pen + glyph->left + glyph->w);
+        pen += glyph->advance;
+    }
+    width = SDL_max(width, pen);
+    if (width == 0)
+        return NULL;
+
+    int height = font->header->line_height;
+    SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height, 8, 0, 0, 0, 0);
+    if (surface == NULL)
+        return NULL;
+
+    pen = 0;
+    for (const unsigned char *c = (const unsigned char *) text; *c; c++) {
+        const UI_BUNDLE_GLYPH *glyph = text_cache_glyph(font, *c);
+        for (int y = 0; y < glyph->h; y++) {
+            int dst_y = glyph->top + y;
+            if (dst_y < 0 || dst_y >= height)
+                continue;
+
+            const Uint8 *src = font->atlas + (glyph->y + y) * font->pitch + glyph->x;
+            Uint8 *dst = (Uint8 *) surface->pixels + dst_y * surface->pitch;
+            for (int x = 0; x < glyph->w; x++) {
+                int dst_x = pen + glyph->left + x;
+                if (dst_x >= 0 && dst_x < width && src[x] > dst[dst_x])
+                    dst[dst_x] = src[x];
+            }
+        }
+        pen += glyph->advance;
+    }
+
+    return surface;
+}
+
+// Label like TTF_RenderText_Blended, the alpha of the color is ignored as
+// the oldest supported SDL_ttf does
+static SDL_Surface *text_cache_render_blended(const char *text, int size, SDL_Color color) {
+    UI_BUNDLE_FONT atlas;
+    if (!ui_bundle_font(size, &atlas)) {
+        TTF_Font *font = text_cache_find_font(size);
+        return font ? TTF_RenderText_Blended(font, text, color) : NULL;
+    }
+
+    SDL_Surface *coverage = text_cache_rasterize(&atlas, text);
+    if (coverage == NULL)
+        return NULL;
+
+    SDL_Surface *surface = SDL_CreateRGBSurface(0, coverage->w, coverage->h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    if (surface) {
+        Uint32 rgb = (Uint32) color.r << 16 | (Uint32) color.g << 8 | color.b;
+        for (int y = 0; y < coverage->h; y++) {
+            const Uint8 *src = (const Uint8 *) coverage->pixels + y * coverage->pitch;
+            Uint32 *dst = (Uint32 *) ((Uint8 *) surface->pixels + y * surface->pitch);
+            for (int x = 0; x < coverage->w; x++)
+                dst[x] = (Uint32) src[x] << 24 | rgb;
+        }
+    }
+
+    SDL_FreeSurface(coverage);
+    return surface;
+}
+
+// Returns the cached label or renders it, evicting the least recently
+// used labels over the count or memory bound. Call with the mutex held.
+static SDL_Surface *text_cache_find_label(const char *text, int size, SDL_Color color) {
+    Uint32 key = (Uint32) color.r << 24 | (Uint32) color.g << 16 | (Uint32) color.b << 8 | color.a;
+    TEXT_CACHE_LABEL *oldest = &labels[0];
+    for (int i = 0; i < TEXT_CACHE_LABELS; i++) {
+        TEXT_CACHE_LABEL *label = &labels[i];
+        if (label->surface && label->size == size && label->color == key && strcmp(label->text, text) == 0) {
+            label->last_used = ++use_counter;
+            stats.hits++;
+            return label->surface;
+        }
+
+        if (label->last_used < oldest->last_used)
+            oldest = label;
+    }
+
+    SDL_Surface *surface = text_cache_render_blended(text, size, color);
+    if (surface == NULL) {
+        fprintf(stderr, "Could not render text: %s\n", TTF_GetError());
+        return NULL;
+    }
+
+    stats.misses++;
+    size_t bytes = (size_t) surface->pitch * surface->h;
+    if (oldest->surface) {
+        text_cache_evict(oldest);
+        stats.evictions++;
+    }
+
+    // Stay within the memory bound, the new label is kept even if it's larger
+    while (label_bytes + bytes > TEXT_CACHE_BYTES) {
+        TEXT_CACHE_LABEL *victim = NULL;
+        for (int i = 0; i < TEXT_CACHE_LABELS; i++) {
+            if (labels[i].surface && (victim == NULL || labels[i].last_used < victim->last_used))
+                victim = &labels[i];
+        }
+        if (victim == NULL)
+            break;
+
+        text_cache_evict(victim);
+        stats.evictions++;
+    }
+
+    *oldest = (TEXT_CACHE_LABEL) {strdup(text), size, key, surface, bytes, ++use_counter};
+    label_bytes += bytes;
+    return surface;
+}
+
+bool text_cache_draw(SDL_Surface *dst, const SDL_Rect *rect, const char *text, int size, SDL_Color color) {
+    SDL_LockMutex(mutex);
+    SDL_Surface *surface = text_cache_find_label(text, size, color);
+    if (surface) {
+        SDL_Rect text_rect = {rect->x + (rect->w - surface->w) / 2, rect->y + (rect->h - surface->h) / 2, surface->w, surface->h};
+        SDL_BlitSurface(surface, NULL, dst, &text_rect);
+    }
+    SDL_UnlockMutex(mutex);
+
+    return surface != NULL;
+}
+
+SDL_Texture *text_cache_texture(SDL_Renderer *renderer, const char *text, int size, SDL_Color color, int *w, int *h) {
+    SDL_Texture *texture = NULL;
+
+    SDL_LockMutex(mutex);
+    SDL_Surface *surface = text_cache_find_label(text, size, color);
+    if (surface) {
+        texture = SDL_CreateTextureFromSurface(renderer, surface);
+        *w = surface->w;
+        *h = surface->h;
+    }
+    SDL_UnlockMutex(mutex);
+
+    return texture;
+}
+
+SDL_Surface *text_cache_render_shaded(const char *text, int size, SDL_Color fg, SDL_Color bg) {
+    UI_BUNDLE_FONT atlas;
+    SDL_Surface *surface = NULL;
+
+    SDL_LockMutex(mutex);
+    if (!ui_bundle_font(size, &atlas)) {
+        TTF_Font *font = text_cache_find_font(size);
+        if (font)
+            surface = TTF_RenderText_Shaded(font, text, fg, bg);
+    } else if ((surface = text_cache_rasterize(&atlas, text)) != NULL) {
+        SDL_Color colors[256];
+        for (int i = 0; i < 256; i++) {
+            colors[i].r = bg.r + (fg.r - bg.r) * i / 255;
+            colors[i].g = bg.g + (fg.g - bg.g) * i / 255;
+            colors[i].b = bg.b + (fg.b - bg.b) * i / 255;
+            colors[i].a = 255;
+        }
+        SDL_SetPaletteColors(surface->format->palette, colors, 0, 256);
+    }
+    SDL_UnlockMutex(mutex);
+
+    return surface;
+}
+
+void text_cache_get_stats(PTEXT_CACHE_STATS cache_stats) {
+    SDL_LockMutex(mutex);
+    *cache_stats = stats;
+    SDL_UnlockMutex(mutex);
+}
+
+#endif /* HAVE_SDL */
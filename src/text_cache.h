@@ -0,0 +1,57 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef HAVE_SDL
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _TEXT_CACHE_STATS {
+    uint64_t font_opens;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} TEXT_CACHE_STATS, *PTEXT_CACHE_STATS;
+
+// Labels are drawn from the glyph atlases of the UI bundle, sizes missing
+// from it fall back to MOONLIGHT_FONT which stays open for the lifetime of
+// the process, one per point size. Rendered labels are kept in a bounded LRU
+// keyed by text, size and color.
+// Call after TTF_Init, all functions are safe to call from any thread.
+void text_cache_init(void);
+void text_cache_destroy(void);
+
+// Blits a label centered in rect, returns false when it couldn't be rendered
+bool text_cache_draw(SDL_Surface *dst, const SDL_Rect *rect, const char *text, int size, SDL_Color color);
+
+// Texture of a label to draw with the renderer, destroyed by the caller.
+// w and h receive the size of the label.
+SDL_Texture *text_cache_texture(SDL_Renderer *renderer, const char *text, int size, SDL_Color color, int *w, int *h);
+
+// Uncached palettized label on an opaque background like
+// TTF_RenderText_Shaded, for text that changes all the time. Freed by the
+// caller, NULL when it couldn't be rendered.
+SDL_Surface *text_cache_render_shaded(const char *text, int size, SDL_Color fg, SDL_Color bg);
+
+void text_cache_get_stats(PTEXT_CACHE_STATS stats);
+
+#endif /* HAVE_SDL */
@@ -0,0 +1,153 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_SDL
+
+#include "ui_bundle.h"
+#include "sdl.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const uint8_t *bundle;
+static size_t bundle_size;
+static const UI_BUNDLE_ENTRY *entries;
+static int entry_count;
+
+// Checks an entry against the file, so lookups and text rendering never read
+// past the mapping
+static bool ui_bundle_entry_valid(const uint8_t *map, size_t size, const UI_BUNDLE_ENTRY *entry) {
+    if (entry->offset > size || entry->size > size - entry->offset)
+        return false;
+
+    if (entry->type == UI_BUNDLE_TYPE_IMAGE)
+        return entry->size >= (uint32_t) entry->width * entry->height * 2;
+
+    if (entry->type != UI_BUNDLE_TYPE_FONT)
+        return true;
+
+    if (entry->size < sizeof(UI_BUNDLE_FONT_HEADER) + (uint32_t) entry->width * entry->height)
+        return false;
+
+    const UI_BUNDLE_FONT_HEADER *font = (const UI_BUNDLE_FONT_HEADER *) (map + entry->offset);
+    for (int i = 0; i < UI_BUNDLE_GLYPHS; i++) {
+        const UI_BUNDLE_GLYPH *glyph = &font->glyphs[i];
+        if ((uint32_t) glyph->x + glyph->w > entry->width || (uint32_t) glyph->y + glyph->h > entry->height)
+            return false;
+    }
+
+    return true;
+}
+
+bool ui_bundle_init(void) {
+    if (bundle)
+        return true;
+
+    int fd = open(UI_BUNDLE, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "UI bundle %s not found, loading assets separately\n", UI_BUNDLE);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(UI_BUNDLE_HEADER)) {
+        close(fd);
+        return false;
+    }
+
+    const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("UI bundle: mmap");
+        return false;
+    }
+
+    const UI_BUNDLE_HEADER *header = (const UI_BUNDLE_HEADER *) map;
+    size_t index_end = sizeof(UI_BUNDLE_HEADER) + (size_t) header->entry_count * sizeof(UI_BUNDLE_ENTRY);
+    if (header->magic != UI_BUNDLE_MAGIC || header->version != UI_BUNDLE_VERSION || index_end > (size_t) st.st_size) {
+        fprintf(stderr, "%s is not a valid UI bundle\n", UI_BUNDLE);
+        munmap((void *) map, st.st_size);
+        return false;
+    }
+
+    // A damaged entry rejects the whole bundle, the assets are loaded separately then
+    const UI_BUNDLE_ENTRY *index = (const UI_BUNDLE_ENTRY *) (map + sizeof(UI_BUNDLE_HEADER));
+    for (int i = 0; i < header->entry_count; i++) {
+        if (!ui_bundle_entry_valid(map, st.st_size, &index[i])) {
+            fprintf(stderr, "UI bundle: entry %d is damaged\n", i);
+            munmap((void *) map, st.st_size);
+            return false;
+        }
+    }
+
+    // Read the whole bundle in now, it's mapped while the renderer is set up
+    madvise((void *) map, st.st_size, MADV_WILLNEED);
+
+    bundle = map;
+    bundle_size = st.st_size;
+    entries = index;
+    entry_count = header->entry_count;
+    return true;
+}
+
+void ui_bundle_destroy(void) {
+    if (bundle)
+        munmap((void *) bundle, bundle_size);
+
+    bundle = NULL;
+    entries = NULL;
+    entry_count = 0;
+}
+
+static const UI_BUNDLE_ENTRY *ui_bundle_find(const char *name, uint32_t type) {
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].type == type && strncmp(entries[i].name, name, UI_BUNDLE_NAME_LENGTH) == 0)
+            return &entries[i];
+    }
+
+    return NULL;
+}
+
+SDL_Surface *ui_bundle_image(const char *name) {
+    const UI_BUNDLE_ENTRY *entry = ui_bundle_find(name, UI_BUNDLE_TYPE_IMAGE);
+    if (entry == NULL)
+        return NULL;
+
+    // Blitting only reads the source, the mapping can stay read only
+    return SDL_CreateRGBSurfaceFrom((void *) (bundle + entry->offset), entry->width, entry->height, 16, entry->width * 2,
+                                    0xF800, 0x07E0, 0x001F, 0x0000);
+}
+
+bool ui_bundle_font(int size, UI_BUNDLE_FONT *font) {
+    char name[UI_BUNDLE_NAME_LENGTH];
+    snprintf(name, sizeof(name), "font%d", size);
+
+    const UI_BUNDLE_ENTRY *entry = ui_bundle_find(name, UI_BUNDLE_TYPE_FONT);
+    if (entry == NULL)
+        return false;
+
+    font->header = (const UI_BUNDLE_FONT_HEADER *) (bundle + entry->offset);
+    font->atlas = bundle + entry->offset + sizeof(UI_BUNDLE_FONT_HEADER);
+    font->pitch = entry->width;
+    return true;
+}
+
+#endif /* HAVE_SDL */
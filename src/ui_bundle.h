@@ -0,0 +1,97 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The UI bundle is written by tools/uibundle, it holds the images of the
+// menu already converted to the RGB565 panel format and glyph atlases of
+// the menu font at the sizes the UI draws, so startup needs no PNG or TTF
+// decoding. The header is followed by the index, offsets are from the start
+// of the file and 4 byte aligned.
+#define UI_BUNDLE_MAGIC 0x4c444e42
+#define UI_BUNDLE_VERSION 1
+#define UI_BUNDLE_NAME_LENGTH 24
+
+// Latin-1 like TTF_RenderText, control characters have empty glyphs
+#define UI_BUNDLE_FIRST_GLYPH 32
+#define UI_BUNDLE_GLYPHS 224
+
+enum ui_bundle_type { UI_BUNDLE_TYPE_IMAGE = 1, UI_BUNDLE_TYPE_FONT };
+
+typedef struct _UI_BUNDLE_HEADER {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_count;
+} UI_BUNDLE_HEADER;
+
+// Images are width * height opaque RGB565 pixels, fonts a UI_BUNDLE_FONT_HEADER
+// followed by a width * height 8 bit coverage atlas
+typedef struct _UI_BUNDLE_ENTRY {
+    char name[UI_BUNDLE_NAME_LENGTH];
+    uint32_t type;
+    uint32_t offset;
+    uint32_t size;
+    uint16_t width;
+    uint16_t height;
+} UI_BUNDLE_ENTRY;
+
+// Glyph bitmap in the atlas, placed at left and top from the pen position
+// on the top of the line
+typedef struct _UI_BUNDLE_GLYPH {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+    int16_t left;
+    int16_t top;
+    uint16_t advance;
+    uint16_t reserved;
+} UI_BUNDLE_GLYPH;
+
+typedef struct _UI_BUNDLE_FONT_HEADER {
+    uint16_t size;
+    uint16_t line_height;
+    UI_BUNDLE_GLYPH glyphs[UI_BUNDLE_GLYPHS];
+} UI_BUNDLE_FONT_HEADER;
+
+#ifdef HAVE_SDL
+
+#include <SDL.h>
+
+typedef struct _UI_BUNDLE_FONT {
+    const UI_BUNDLE_FONT_HEADER *header;
+    const uint8_t *atlas;
+    int pitch;
+} UI_BUNDLE_FONT;
+
+// Maps UI_BUNDLE once, returns false when there is no valid bundle and the
+// UI has to fall back to loading the PNG and TTF files. The bundle is read
+// only after init so lookups are safe from any thread.
+bool ui_bundle_init(void);
+void ui_bundle_destroy(void);
+
+// Surface of an image pointing into the bundle or NULL when missing, free it
+// with SDL_FreeSurface before ui_bundle_destroy
+SDL_Surface *ui_bundle_image(const char *name);
+
+// Glyph atlas of the font at a point size, false when it isn't bundled
+bool ui_bundle_font(int size, UI_BUNDLE_FONT *font);
+
+#endif /* HAVE_SDL */
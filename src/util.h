@@ -28,3 +28,4 @@ void is_dir_exist_and_remove(const char *dirpath);
 int write_bool(char *path, bool val);
 int read_file(char *path, char *output, int output_len);
 bool ensure_buf_size(void **buf, size_t *buf_size, size_t required_size);
+void neon_memcpy(void *dest, const void *src, size_t n);
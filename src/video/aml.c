@@ -36,6 +36,7 @@
 #include <linux/videodev2.h>
 
 #include "../util.h"
+#include "../latency.h"
 #include "video.h"
 
 #define SYNC_OUTSIDE 0x02
@@ -175,19 +176,29 @@ void aml_cleanup() {
 
 int aml_submit_decode_unit(PDECODE_UNIT decodeUnit) {
 
-  ensure_buf_size(&pkt_buf, &pkt_buf_size, decodeUnit->fullLength);
-
   int written = 0, length = 0, errCounter = 0, api;
   PLENTRY entry = decodeUnit->bufferList;
-  do {
-    neon_memcpy(pkt_buf+length, entry->data, entry->length);
-    length += entry->length;
-    entry = entry->next;
-  } while (entry != NULL);
+  char* data;
+
+  latency_record_host(LATENCY_SUBMIT, decodeUnit->receiveTimeMs);
+  if (entry->next == NULL) {
+    // codec_write() copies into the kernel anyway, no need to gather first
+    data = entry->data;
+    length = entry->length;
+  } else {
+    ensure_buf_size(&pkt_buf, &pkt_buf_size, decodeUnit->fullLength);
+    do {
+      neon_memcpy(pkt_buf+length, entry->data, entry->length);
+      length += entry->length;
+      entry = entry->next;
+    } while (entry != NULL);
+    data = pkt_buf;
+  }
 
+  uint64_t start = latency_now_us();
   codec_checkin_pts(&codecParam, decodeUnit->presentationTimeMs);
   while (length > 0) {
-    api = codec_write(&codecParam, pkt_buf+written, length);
+    api = codec_write(&codecParam, data+written, length);
     if (api < 0) {
       if (errno != EAGAIN) {
         fprintf(stderr, "codec_write() error: %x %d\n", errno, api);
@@ -205,6 +216,7 @@ int aml_submit_decode_unit(PDECODE_UNIT decodeUnit) {
       length -= api;
     }
   }
+  latency_record_since(LATENCY_SEND_PACKET, start);
 
   return length ? DR_NEED_IDR : DR_OK;
 }
@@ -0,0 +1,193 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decode_queue.h"
+#include "ffmpeg.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct _DECODE_QUEUE_SLOT {
+  DECODE_UNIT unit;
+  LENTRY entry;
+  AVBufferRef* packet;
+} DECODE_QUEUE_SLOT, *PDECODE_QUEUE_SLOT;
+
+static PDECODE_QUEUE_SLOT slots;
+static int queue_depth;
+static int head, count;
+static bool busy, done;
+static bool waiting_for_idr, idr_requested;
+
+static DecodeQueueSubmit queue_submit;
+static DECODE_QUEUE_STATS queue_stats;
+
+static pthread_t worker_thread;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static void* decode_queue_worker(void* data) {
+  pthread_mutex_lock(&queue_mutex);
+  while (!done) {
+    if (count == 0) {
+      pthread_cond_wait(&queue_cond, &queue_mutex);
+      continue;
+    }
+
+    PDECODE_QUEUE_SLOT slot = &slots[head];
+    busy = true;
+    pthread_mutex_unlock(&queue_mutex);
+
+    int ret = queue_submit(&slot->unit, slot->packet);
+    slot->packet = NULL;
+
+    pthread_mutex_lock(&queue_mutex);
+    busy = false;
+    head = (head + 1) % queue_depth;
+    count--;
+    queue_stats.decoded++;
+
+    // The worker can't return DR_NEED_IDR itself, so report it on the next submit
+    if (ret == DR_NEED_IDR)
+      idr_requested = true;
+  }
+  pthread_mutex_unlock(&queue_mutex);
+
+  return NULL;
+}
+
+int decode_queue_init(int depth, DecodeQueueSubmit submit) {
+  slots = calloc(depth, sizeof(DECODE_QUEUE_SLOT));
+  if (slots == NULL) {
+    fprintf(stderr, "Couldn't allocate decode queue\n");
+    return -1;
+  }
+
+  queue_depth = depth;
+  queue_submit = submit;
+  head = count = 0;
+  busy = done = false;
+  waiting_for_idr = idr_requested = false;
+  memset(&queue_stats, 0, sizeof(queue_stats));
+  queue_stats.depth = depth;
+
+  if (pthread_create(&worker_thread, NULL, decode_queue_worker, NULL) != 0) {
+    fprintf(stderr, "Couldn't create decode thread\n");
+    decode_queue_destroy();
+    return -1;
+  }
+
+  return 0;
+}
+
+void decode_queue_destroy(void) {
+  if (slots == NULL)
+    return;
+
+  if (worker_thread) {
+    pthread_mutex_lock(&queue_mutex);
+    done = true;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+    pthread_join(worker_thread, NULL);
+    worker_thread = 0;
+  }
+
+  for (int i = 0; i < queue_depth; i++)
+    av_buffer_unref(&slots[i].packet);
+
+  free(slots);
+  slots = NULL;
+}
+
+int decode_queue_submit(PDECODE_UNIT decodeUnit) {
+  int ret = DR_OK;
+
+  pthread_mutex_lock(&queue_mutex);
+  if (idr_requested) {
+    idr_requested = false;
+    waiting_for_idr = true;
+    ret = DR_NEED_IDR;
+  }
+
+  if (waiting_for_idr && decodeUnit->frameType != FRAME_TYPE_IDR) {
+    queue_stats.dropped++;
+    goto unlock;
+  }
+  waiting_for_idr = false;
+
+  if (count == queue_depth) {
+    // The decoder can't keep up, so throw away everything that hasn't been
+    // picked up yet and restart from the next IDR frame
+    int queued = busy ? count - 1 : count;
+    for (int i = count - queued; i < count; i++)
+      av_buffer_unref(&slots[(head + i) % queue_depth].packet);
+
+    count -= queued;
+    queue_stats.dropped += queued;
+    queue_stats.overflows++;
+
+    // An IDR frame is where the decoder would restart anyway, queue it
+    // instead of waiting a round trip for the next one
+    if (decodeUnit->frameType != FRAME_TYPE_IDR || count == queue_depth) {
+      queue_stats.dropped++;
+      waiting_for_idr = true;
+      ret = DR_NEED_IDR;
+      goto unlock;
+    }
+  }
+
+  int index = (head + count) % queue_depth;
+  pthread_mutex_unlock(&queue_mutex);
+
+  // Only the producer touches slots beyond the queued range, so the copy
+  // happens without holding the lock. The copy is the only one made, as
+  // the padded buffer is handed to the decoder by reference afterwards.
+  PDECODE_QUEUE_SLOT slot = &slots[index];
+  slot->packet = ffmpeg_gather_decode_unit(decodeUnit);
+  if (slot->packet == NULL)
+    return DR_NEED_IDR;
+
+  slot->unit = *decodeUnit;
+  slot->unit.bufferList = &slot->entry;
+  slot->entry = *decodeUnit->bufferList;
+  slot->entry.next = NULL;
+  slot->entry.data = (char*) slot->packet->data;
+  slot->entry.length = decodeUnit->fullLength;
+
+  pthread_mutex_lock(&queue_mutex);
+  count++;
+  queue_stats.enqueued++;
+  if (count > queue_stats.peak_occupancy)
+    queue_stats.peak_occupancy = count;
+
+  pthread_cond_signal(&queue_cond);
+
+  unlock:
+  pthread_mutex_unlock(&queue_mutex);
+  return ret;
+}
+
+void decode_queue_get_stats(PDECODE_QUEUE_STATS stats) {
+  pthread_mutex_lock(&queue_mutex);
+  *stats = queue_stats;
+  stats->occupancy = count;
+  pthread_mutex_unlock(&queue_mutex);
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Limelight.h>
+#include <libavcodec/avcodec.h>
+
+#include <stdint.h>
+
+typedef int(*DecodeQueueSubmit)(PDECODE_UNIT decodeUnit, AVBufferRef* buffer);
+
+typedef struct _DECODE_QUEUE_STATS {
+  int depth;
+  int occupancy;
+  int peak_occupancy;
+  uint64_t enqueued;
+  uint64_t decoded;
+  uint64_t dropped;
+  uint64_t overflows;
+} DECODE_QUEUE_STATS, *PDECODE_QUEUE_STATS;
+
+int decode_queue_init(int depth, DecodeQueueSubmit submit);
+void decode_queue_destroy(void);
+int decode_queue_submit(PDECODE_UNIT decodeUnit);
+void decode_queue_get_stats(PDECODE_QUEUE_STATS stats);
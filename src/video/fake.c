@@ -0,0 +1,125 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "video.h"
+#include "ffmpeg.h"
+#include "yuv2rgb565.h"
+
+#include "../latency.h"
+#include "../platform.h"
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Frames are converted for a panel of this size, like the SDL renderer does
+#define FAKE_OUTPUT_WIDTH 640
+#define FAKE_OUTPUT_HEIGHT 480
+#define FAKE_BUFFER_FRAMES 1
+
+static int decode_threads;
+static uint16_t* output;
+static int output_width, output_height;
+static uint64_t converted, unsupported;
+
+void fake_video_prepare(void) {
+  decode_threads = ffmpeg_decode_threads();
+  decoder_callbacks_fake.capabilities &= ~CAPABILITY_SLICES_PER_FRAME(0xFF);
+  decoder_callbacks_fake.capabilities |= CAPABILITY_SLICES_PER_FRAME(decode_threads);
+}
+
+static int fake_setup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) {
+  if (decode_threads == 0)
+    decode_threads = ffmpeg_decode_threads();
+
+  int perf_lvl = 0;
+  if (decode_threads > 1)
+    perf_lvl |= videoFormat & VIDEO_FORMAT_MASK_AV1 ? FRAME_THREADING : SLICE_THREADING;
+
+  ffmpeg_set_cache_dir(config.key_dir);
+  if (ffmpeg_init(videoFormat, width, height, perf_lvl, FAKE_BUFFER_FRAMES, decode_threads) < 0) {
+    fprintf(stderr, "Couldn't initialize video decoding\n");
+    return -1;
+  }
+
+  ffmpeg_set_frame_rate(redrawRate);
+  if (config.fast_decode)
+    ffmpeg_enable_fast_decode();
+
+  if (yuv2rgb565_init(config.scaler == SCALER_NEAREST ? YUV_SCALE_NEAREST : YUV_SCALE_BILINEAR) < 0) {
+    fprintf(stderr, "Couldn't initialize frame conversion\n");
+    return -1;
+  }
+
+  // Keep the aspect ratio of the stream
+  if (width * FAKE_OUTPUT_HEIGHT > height * FAKE_OUTPUT_WIDTH) {
+    output_width = FAKE_OUTPUT_WIDTH;
+    output_height = FAKE_OUTPUT_WIDTH * height / width;
+  } else {
+    output_width = FAKE_OUTPUT_HEIGHT * width / height;
+    output_height = FAKE_OUTPUT_HEIGHT;
+  }
+
+  output = malloc(output_width * output_height * sizeof(uint16_t));
+  if (output == NULL) {
+    fprintf(stderr, "Not enough memory\n");
+    return -1;
+  }
+
+  converted = unsupported = 0;
+  printf("Fake video: decoding %dx%d with %d thread%s into a %dx%d offscreen buffer\n", width, height, decode_threads, decode_threads > 1 ? "s" : "", output_width, output_height);
+  return 0;
+}
+
+static void fake_cleanup() {
+  if (converted > 0 || unsupported > 0)
+    printf("Fake video: %llu frames converted, %llu in an unsupported format\n", (unsigned long long) converted, (unsigned long long) unsupported);
+
+  free(output);
+  output = NULL;
+  yuv2rgb565_destroy();
+  ffmpeg_destroy();
+}
+
+static int fake_submit_decode_unit(PDECODE_UNIT decodeUnit) {
+  latency_record_host(LATENCY_SUBMIT, decodeUnit->receiveTimeMs);
+  int ret = ffmpeg_submit_decode_unit(decodeUnit, NULL);
+
+  AVFrame* frame = ffmpeg_get_frame(false);
+  if (frame != NULL) {
+    ffmpeg_set_colorspace(frame, decodeUnit->colorspace);
+    uint64_t start = latency_now_us();
+    if (yuv2rgb565_convert_frame(frame, output, output_width * sizeof(uint16_t), output_width, output_height) == 0) {
+      latency_record_since(LATENCY_UPLOAD, start);
+      if (frame->pts != AV_NOPTS_VALUE)
+        latency_record_host(LATENCY_END_TO_END, frame->pts);
+      converted++;
+    } else
+      unsupported++;
+
+    ffmpeg_release_frame(frame);
+  }
+
+  return ret;
+}
+
+DECODER_RENDERER_CALLBACKS decoder_callbacks_fake = {
+  .setup = fake_setup,
+  .cleanup = fake_cleanup,
+  .submitDecodeUnit = fake_submit_decode_unit,
+  .capabilities = CAPABILITY_SLICES_PER_FRAME(MAX_DECODE_THREADS) | CAPABILITY_REFERENCE_FRAME_INVALIDATION_HEVC | CAPABILITY_DIRECT_SUBMIT,
+};
@@ -18,11 +18,15 @@
  */
 
 #include "ffmpeg.h"
+#include "video.h"
 
 #ifdef HAVE_VAAPI
 #include "ffmpeg_vaapi.h"
 #endif
 
+#include "../util.h"
+#include "../latency.h"
+
 #include <Limelight.h>
 #include <libavcodec/avcodec.h>
 
@@ -30,20 +34,350 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 // General decoder and renderer state
 static AVPacket* pkt;
 static const AVCodec* decoder;
 static AVCodecContext* decoder_ctx;
-static AVFrame** dec_frames;
 
-static int dec_frames_cnt;
-static int current_frame, next_frame;
+// Pool of decoded frames shared with the renderer. A slot is only handed
+// out again once every reference to its frame has been released.
+typedef struct _FRAME_SLOT {
+  AVFrame* frame;
+  int refs;
+  bool free;
+} FRAME_SLOT;
+
+static FRAME_SLOT* frame_slots;
+static int frame_slots_cnt;
+static int frames_in_use;
+static AVFrame* drop_frame;
+
+static FFMPEG_FRAME_STATS frame_stats;
+
+// Pool of padded packet buffers which can be handed to the decoder by reference
+static AVBufferPool* packet_pool;
+static int packet_pool_size;
+
+static FFMPEG_SUBMIT_STATS submit_stats;
+
+// Pool of contiguous frame buffers, see ffmpeg_get_buffer
+static AVBufferPool* frame_pool;
+static int frame_pool_size;
+static pthread_mutex_t frame_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Decoders in order of preference, the first one that opens is used
+typedef struct _DECODER_CANDIDATE {
+  int video_format;
+  const char* name;
+  // Dedicated decoders can't be combined with a hwaccel
+  bool standalone;
+} DECODER_CANDIDATE;
+
+static const DECODER_CANDIDATE decoder_candidates[] = {
+  {VIDEO_FORMAT_MASK_H264, "h264_nvv4l2", true}, // Tegra
+  {VIDEO_FORMAT_MASK_H264, "h264_nvmpi", true}, // Tegra
+  {VIDEO_FORMAT_MASK_H264, "h264_omx", true}, // VisionFive
+  {VIDEO_FORMAT_MASK_H264, "h264_v4l2m2m", true}, // Stateful V4L2
+  {VIDEO_FORMAT_MASK_H264, "h264", false}, // Software and hwaccel
+  {VIDEO_FORMAT_MASK_H265, "hevc_nvv4l2", true}, // Tegra
+  {VIDEO_FORMAT_MASK_H265, "hevc_nvmpi", true}, // Tegra
+  {VIDEO_FORMAT_MASK_H265, "hevc_omx", true}, // VisionFive
+  {VIDEO_FORMAT_MASK_H265, "hevc_v4l2m2m", true}, // Stateful V4L2
+  {VIDEO_FORMAT_MASK_H265, "hevc", false}, // Software and hwaccel
+  {VIDEO_FORMAT_MASK_AV1, "libdav1d", true},
+  {VIDEO_FORMAT_MASK_AV1, "av1", false}, // Hwaccel
+};
+
+// The decoder that produced the first frame is remembered per codec,
+// acceleration and resolution, so the next start opens it right away
+#define DECODER_CACHE_FILE "decoders"
+#define DECODER_CACHE_LINES 64
+
+static char decoder_cache_path[4096];
+static char decoder_cache_key[64];
+static int64_t open_latency, first_packet_time;
+static bool first_frame_pending;
+
+// Automatic fast decode, decode time is a moving average in microseconds
+#define DECODE_TIME_WEIGHT 16
+static bool fast_decode_allowed, fast_decode_active;
+static int64_t frame_budget, decode_time;
+
+// Decode time runs from sending a packet until its frame comes out, which
+// the pts carried to the frame finds again. With frame threads
+// avcodec_send_packet only hands the packet over, and every frame waits
+// for the ones decoded in parallel, so the time is divided by their count.
+#define SEND_TIMES 16
+static struct {
+  int64_t pts;
+  int64_t sent_us;
+} send_times[SEND_TIMES];
+static unsigned int send_index;
+static int pipeline_frames = 1;
+
+// Overload controller, non-reference frames are skipped while decoding is
+// over budget and skipping stops again below 3/4 of it. Units arriving more
+// than BACKLOG_FRAMES frame intervals late for BACKLOG_UNITS units in a row
+// are dropped and decoding restarts from an IDR frame.
+#define BACKLOG_FRAMES 3
+#define BACKLOG_UNITS 8
+static bool skipping_nonref, receive_failed;
+static int backlog_units;
+
+static FFMPEG_DROP_STATS drop_stats;
 
 enum decoders ffmpeg_decoder;
 
 #define BYTES_PER_PIXEL 4
 
+// Alignment of the chroma planes, luma is aligned twice as much
+#define FRAME_ALIGN 32
+
+// Allocate all planes of a frame from one pooled buffer in YV12 texture
+// order (Y, V, U) with tight chroma pitches, so the renderer can upload a
+// frame with a single copy. The pool keeps a buffer out of circulation
+// until the decoder and every renderer reference to it are released.
+static int ffmpeg_get_buffer(AVCodecContext* ctx, AVFrame* frame, int flags) {
+  if (frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_YUVJ420P)
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+
+  int width = frame->width, height = frame->height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+  for (int i = 0; i < 3; i++) {
+    if (linesize_align[i] > FRAME_ALIGN)
+      return avcodec_default_get_buffer2(ctx, frame, flags);
+  }
+
+  int luma_pitch = FFALIGN(width, 2 * FRAME_ALIGN);
+  int chroma_pitch = luma_pitch / 2;
+  height = FFALIGN(height, 2);
+  int luma_size = luma_pitch * height;
+  int chroma_size = chroma_pitch * (height / 2);
+  int size = luma_size + 2 * chroma_size;
+
+  // Frame threads may allocate concurrently, the pool itself is thread-safe
+  pthread_mutex_lock(&frame_pool_mutex);
+  if (size != frame_pool_size) {
+    // Buffers still referenced keep the old pool alive until they are released
+    if (frame_pool)
+      av_buffer_pool_uninit(&frame_pool);
+
+    frame_pool = av_buffer_pool_init(size + AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+    frame_pool_size = frame_pool ? size : 0;
+  }
+  frame->buf[0] = frame_pool ? av_buffer_pool_get(frame_pool) : NULL;
+  pthread_mutex_unlock(&frame_pool_mutex);
+
+  if (frame->buf[0] == NULL)
+    return AVERROR(ENOMEM);
+
+  frame->data[0] = frame->buf[0]->data;
+  frame->data[2] = frame->data[0] + luma_size;
+  frame->data[1] = frame->data[2] + chroma_size;
+  frame->linesize[0] = luma_pitch;
+  frame->linesize[1] = frame->linesize[2] = chroma_pitch;
+  frame->extended_data = frame->data;
+
+  return 0;
+}
+
+int ffmpeg_contiguous_height(const AVFrame* frame) {
+  if (frame->buf[0] == NULL || frame->buf[1] != NULL || frame->data[0] != frame->buf[0]->data)
+    return 0;
+
+  int luma_pitch = frame->linesize[0], chroma_pitch = frame->linesize[1];
+  if (luma_pitch <= 0 || chroma_pitch * 2 != luma_pitch || frame->linesize[2] != chroma_pitch)
+    return 0;
+
+  ptrdiff_t luma_size = frame->data[2] - frame->data[0];
+  if (luma_size % luma_pitch != 0)
+    return 0;
+
+  int height = luma_size / luma_pitch;
+  if (height < frame->height || frame->data[1] != frame->data[2] + chroma_pitch * (height / 2))
+    return 0;
+
+  return height;
+}
+
+static int64_t ffmpeg_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void ffmpeg_set_cache_dir(const char* dir) {
+  if (dir == NULL || dir[0] == 0)
+    decoder_cache_path[0] = 0;
+  else
+    snprintf(decoder_cache_path, sizeof(decoder_cache_path), "%s/%s", dir, DECODER_CACHE_FILE);
+}
+
+static bool decoder_cache_lookup(const char* key, char* name, size_t name_len) {
+  if (decoder_cache_path[0] == 0)
+    return false;
+
+  FILE* fd = fopen(decoder_cache_path, "r");
+  if (fd == NULL)
+    return false;
+
+  bool found = false;
+  char line[256], line_key[64], line_name[64];
+  while (!found && fgets(line, sizeof(line), fd) != NULL) {
+    if (sscanf(line, "%63s %63s", line_key, line_name) == 2 && strcmp(line_key, key) == 0) {
+      snprintf(name, name_len, "%s", line_name);
+      found = true;
+    }
+  }
+
+  fclose(fd);
+  return found;
+}
+
+static void decoder_cache_store(const char* key, const char* name, int64_t open_us, int64_t first_frame_us) {
+  if (decoder_cache_path[0] == 0)
+    return;
+
+  // Keep the entries of other codecs and resolutions
+  static char lines[DECODER_CACHE_LINES][256];
+  int count = 0;
+  FILE* fd = fopen(decoder_cache_path, "r");
+  if (fd != NULL) {
+    char line_key[64];
+    while (count < DECODER_CACHE_LINES - 1 && fgets(lines[count], sizeof(lines[count]), fd) != NULL) {
+      if (sscanf(lines[count], "%63s", line_key) == 1 && strcmp(line_key, key) != 0)
+        count++;
+    }
+    fclose(fd);
+  }
+
+  char tmp_path[sizeof(decoder_cache_path) + 4];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", decoder_cache_path);
+  fd = fopen(tmp_path, "w");
+  if (fd == NULL) {
+    fprintf(stderr, "Can't write decoder cache: %s\n", tmp_path);
+    return;
+  }
+
+  for (int i = 0; i < count; i++)
+    fputs(lines[i], fd);
+  fprintf(fd, "%s %s %lld %lld\n", key, name, (long long) open_us, (long long) first_frame_us);
+  fclose(fd);
+
+  if (rename(tmp_path, decoder_cache_path) != 0)
+    fprintf(stderr, "Can't write decoder cache: %s\n", decoder_cache_path);
+}
+
+// Sets decoder and decoder_ctx when the codec opens successfully
+static int ffmpeg_open_decoder(const AVCodec* codec, int width, int height, int perf_lvl, int thread_count) {
+  int64_t start = ffmpeg_time_us();
+
+  decoder_ctx = avcodec_alloc_context3(codec);
+  if (decoder_ctx == NULL) {
+    printf("Couldn't allocate context\n");
+    return -1;
+  }
+
+  // Use low delay decoding
+  decoder_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+
+  if ((perf_lvl & CONTIGUOUS_FRAMES) && ffmpeg_decoder == SOFTWARE && (codec->capabilities & AV_CODEC_CAP_DR1))
+    decoder_ctx->get_buffer2 = ffmpeg_get_buffer;
+
+  // Allow display of corrupt frames and frames missing references
+  decoder_ctx->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT;
+  decoder_ctx->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+
+  // Report decoding errors to allow us to request a key frame
+  decoder_ctx->err_recognition = AV_EF_EXPLODE;
+
+  pipeline_frames = 1;
+  if (perf_lvl & SLICE_THREADING) {
+    decoder_ctx->thread_type = FF_THREAD_SLICE;
+    decoder_ctx->thread_count = thread_count;
+  } else if (perf_lvl & FRAME_THREADING) {
+    decoder_ctx->thread_type = FF_THREAD_FRAME;
+    decoder_ctx->thread_count = thread_count;
+    pipeline_frames = thread_count > 0 ? thread_count : 1;
+  } else {
+    decoder_ctx->thread_count = 1;
+  }
+
+  decoder_ctx->width = width;
+  decoder_ctx->height = height;
+  decoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+
+  int err = avcodec_open2(decoder_ctx, codec, NULL);
+  if (err < 0) {
+    printf("Couldn't open codec: %s\n", codec->name);
+    avcodec_free_context(&decoder_ctx);
+    return -1;
+  }
+
+  decoder = codec;
+  open_latency = ffmpeg_time_us() - start;
+  return 0;
+}
+
+int ffmpeg_decode_threads(void) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores < 1)
+    return 1;
+
+  return cores > MAX_DECODE_THREADS ? MAX_DECODE_THREADS : cores;
+}
+
+void ffmpeg_set_frame_rate(int fps) {
+  frame_budget = fps > 0 ? 1000000 / fps : 0;
+}
+
+void ffmpeg_enable_fast_decode(void) {
+  fast_decode_allowed = true;
+}
+
+int64_t ffmpeg_get_decode_time(void) {
+  return __atomic_load_n(&decode_time, __ATOMIC_RELAXED);
+}
+
+static void ffmpeg_update_decode_time(int64_t elapsed) {
+  __atomic_store_n(&decode_time, decode_time + (elapsed - decode_time) / DECODE_TIME_WEIGHT, __ATOMIC_RELAXED);
+  if (!fast_decode_allowed || fast_decode_active || decode_time <= frame_budget)
+    return;
+
+  // Sticky once enabled, toggling back and forth would only add judder
+  fast_decode_active = true;
+  decoder_ctx->skip_loop_filter = AVDISCARD_ALL;
+  decoder_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+  printf("Decoding takes %.1f ms for a %.1f ms frame budget, enabling fast decode\n", decode_time / 1000.0, frame_budget / 1000.0);
+}
+
+static void ffmpeg_track_send(int64_t pts, int64_t sent_us) {
+  if (pts == AV_NOPTS_VALUE)
+    return;
+
+  send_times[send_index % SEND_TIMES].pts = pts;
+  send_times[send_index % SEND_TIMES].sent_us = sent_us;
+  send_index++;
+}
+
+static void ffmpeg_track_receive(int64_t pts) {
+  if (pts == AV_NOPTS_VALUE)
+    return;
+
+  for (int i = 0; i < SEND_TIMES; i++) {
+    if (send_times[i].pts == pts && send_times[i].sent_us != 0) {
+      ffmpeg_update_decode_time((ffmpeg_time_us() - send_times[i].sent_us) / pipeline_frames);
+      send_times[i].sent_us = 0;
+      return;
+    }
+  }
+}
+
 // This function must be called before
 // any other decoding functions
 int ffmpeg_init(int videoFormat, int width, int height, int perf_lvl, int buffer_count, int thread_count) {
@@ -61,71 +395,46 @@ int ffmpeg_init(int videoFormat, int width, int height, int perf_lvl, int buffer
 
   ffmpeg_decoder = perf_lvl & VAAPI_ACCELERATION ? VAAPI : SOFTWARE;
 
-  for (int try = 0; try < 6; try++) {
-    if (videoFormat & VIDEO_FORMAT_MASK_H264) {
-      if (ffmpeg_decoder == SOFTWARE) {
-        if (try == 0) decoder = avcodec_find_decoder_by_name("h264_nvv4l2"); // Tegra
-        if (try == 1) decoder = avcodec_find_decoder_by_name("h264_nvmpi"); // Tegra
-        if (try == 2) decoder = avcodec_find_decoder_by_name("h264_omx"); // VisionFive
-        if (try == 3) decoder = avcodec_find_decoder_by_name("h264_v4l2m2m"); // Stateful V4L2
-      }
-      if (try == 4) decoder = avcodec_find_decoder_by_name("h264"); // Software and hwaccel
-    } else if (videoFormat & VIDEO_FORMAT_MASK_H265) {
-      if (ffmpeg_decoder == SOFTWARE) {
-        if (try == 0) decoder = avcodec_find_decoder_by_name("hevc_nvv4l2"); // Tegra
-        if (try == 1) decoder = avcodec_find_decoder_by_name("hevc_nvmpi"); // Tegra
-        if (try == 2) decoder = avcodec_find_decoder_by_name("hevc_omx"); // VisionFive
-        if (try == 3) decoder = avcodec_find_decoder_by_name("hevc_v4l2m2m"); // Stateful V4L2
-      }
-      if (try == 4) decoder = avcodec_find_decoder_by_name("hevc"); // Software and hwaccel
-    } else if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
-      if (ffmpeg_decoder == SOFTWARE) {
-        if (try == 0) decoder = avcodec_find_decoder_by_name("libdav1d");
-      }
-      if (try == 1) decoder = avcodec_find_decoder_by_name("av1"); // Hwaccel
-    } else {
-      printf("Video format not supported\n");
-      return -1;
-    }
-
-    // Skip this decoder if it isn't compiled into FFmpeg
-    if (!decoder) {
-      continue;
-    }
-
-    decoder_ctx = avcodec_alloc_context3(decoder);
-    if (decoder_ctx == NULL) {
-      printf("Couldn't allocate context\n");
-      return -1;
-    }
-
-    // Use low delay decoding
-    decoder_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
-
-    // Allow display of corrupt frames and frames missing references
-    decoder_ctx->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT;
-    decoder_ctx->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+  const char* codec_name;
+  int format_mask;
+  if (videoFormat & VIDEO_FORMAT_MASK_H264) {
+    format_mask = VIDEO_FORMAT_MASK_H264;
+    codec_name = "h264";
+  } else if (videoFormat & VIDEO_FORMAT_MASK_H265) {
+    format_mask = VIDEO_FORMAT_MASK_H265;
+    codec_name = "hevc";
+  } else if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
+    format_mask = VIDEO_FORMAT_MASK_AV1;
+    codec_name = "av1";
+  } else {
+    printf("Video format not supported\n");
+    return -1;
+  }
 
-    // Report decoding errors to allow us to request a key frame
-    decoder_ctx->err_recognition = AV_EF_EXPLODE;
+  snprintf(decoder_cache_key, sizeof(decoder_cache_key), "%s-%s-%dx%d", codec_name, ffmpeg_decoder == VAAPI ? "vaapi" : "software", width, height);
 
-    if (perf_lvl & SLICE_THREADING) {
-      decoder_ctx->thread_type = FF_THREAD_SLICE;
-      decoder_ctx->thread_count = thread_count;
-    } else {
-      decoder_ctx->thread_count = 1;
-    }
+  // Start with the decoder that produced frames last time
+  char cached_name[64] = "";
+  decoder = NULL;
+  if (decoder_cache_lookup(decoder_cache_key, cached_name, sizeof(cached_name))) {
+    const AVCodec* codec = avcodec_find_decoder_by_name(cached_name);
+    if (codec != NULL)
+      ffmpeg_open_decoder(codec, width, height, perf_lvl, thread_count);
+  }
 
-    decoder_ctx->width = width;
-    decoder_ctx->height = height;
-    decoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+  for (int i = 0; decoder == NULL && i < sizeof(decoder_candidates) / sizeof(decoder_candidates[0]); i++) {
+    const DECODER_CANDIDATE* candidate = &decoder_candidates[i];
+    if (candidate->video_format != format_mask || (candidate->standalone && ffmpeg_decoder != SOFTWARE))
+      continue;
 
-    int err = avcodec_open2(decoder_ctx, decoder, NULL);
-    if (err < 0) {
-      printf("Couldn't open codec: %s\n", decoder->name);
-      avcodec_free_context(&decoder_ctx);
+    // Already failed as the cached choice
+    if (strcmp(candidate->name, cached_name) == 0)
       continue;
-    }
+
+    // Skip this decoder if it isn't compiled into FFmpeg
+    const AVCodec* codec = avcodec_find_decoder_by_name(candidate->name);
+    if (codec != NULL)
+      ffmpeg_open_decoder(codec, width, height, perf_lvl, thread_count);
   }
 
   if (decoder == NULL) {
@@ -133,23 +442,43 @@ int ffmpeg_init(int videoFormat, int width, int height, int perf_lvl, int buffer
     return -1;
   }
 
-  printf("Using FFmpeg decoder: %s\n", decoder->name);
-
-  dec_frames_cnt = buffer_count;
-  dec_frames = malloc(buffer_count * sizeof(AVFrame*));
-  if (dec_frames == NULL) {
+  printf("Using FFmpeg decoder: %s (opened in %.1f ms%s)\n", decoder->name, open_latency / 1000.0, strcmp(decoder->name, cached_name) == 0 ? ", cached choice" : "");
+  first_packet_time = 0;
+  first_frame_pending = true;
+  fast_decode_allowed = fast_decode_active = false;
+  frame_budget = decode_time = 0;
+  memset(send_times, 0, sizeof(send_times));
+  send_index = 0;
+  skipping_nonref = receive_failed = false;
+  backlog_units = 0;
+
+  // The renderer may hold buffer_count frames, one more is needed to receive into
+  frame_slots_cnt = buffer_count + 1;
+  frame_slots = calloc(frame_slots_cnt, sizeof(FRAME_SLOT));
+  if (frame_slots == NULL) {
     fprintf(stderr, "Couldn't allocate frames");
     return -1;
   }
 
-  for (int i = 0; i < buffer_count; i++) {
-    dec_frames[i] = av_frame_alloc();
-    if (dec_frames[i] == NULL) {
+  for (int i = 0; i < frame_slots_cnt; i++) {
+    frame_slots[i].frame = av_frame_alloc();
+    frame_slots[i].free = true;
+    if (frame_slots[i].frame == NULL) {
       fprintf(stderr, "Couldn't allocate frame");
       return -1;
     }
   }
 
+  drop_frame = av_frame_alloc();
+  if (drop_frame == NULL) {
+    fprintf(stderr, "Couldn't allocate frame");
+    return -1;
+  }
+
+  frames_in_use = 0;
+  memset(&frame_stats, 0, sizeof(frame_stats));
+  frame_stats.pool_size = frame_slots_cnt;
+
   #ifdef HAVE_VAAPI
   if (ffmpeg_decoder == VAAPI)
     vaapi_init(decoder_ctx);
@@ -161,34 +490,165 @@ int ffmpeg_init(int videoFormat, int width, int height, int perf_lvl, int buffer
 // This function must be called after
 // decoding is finished
 void ffmpeg_destroy(void) {
+  if (submit_stats.units > 0) {
+    printf("Decode units: %llu submitted, %llu bytes copied, %llu bytes passed to the decoder by reference\n",
+           (unsigned long long) submit_stats.units, (unsigned long long) submit_stats.bytes_copied, (unsigned long long) submit_stats.bytes_referenced);
+  }
+  memset(&submit_stats, 0, sizeof(submit_stats));
+
+  if (drop_stats.idr_requests > 0 || drop_stats.nonref_skipping > 0) {
+    printf("Overload: %llu units decoded skipping non-reference frames, %llu dropped on backlog, %llu decode errors, %llu IDR frames requested\n",
+           (unsigned long long) drop_stats.nonref_skipping, (unsigned long long) drop_stats.backlog,
+           (unsigned long long) drop_stats.decode_errors, (unsigned long long) drop_stats.idr_requests);
+  }
+  memset(&drop_stats, 0, sizeof(drop_stats));
+
+  if (frame_stats.received > 0) {
+    printf("Frame pool: %d frames, peak %d in use, %llu received, %llu dropped on exhaustion\n",
+           frame_stats.pool_size, frame_stats.peak_in_use, (unsigned long long) frame_stats.received, (unsigned long long) frame_stats.exhausted);
+  }
+
   av_packet_free(&pkt);
   if (decoder_ctx) {
     avcodec_free_context(&decoder_ctx);
   }
-  if (dec_frames) {
-    for (int i = 0; i < dec_frames_cnt; i++) {
-      if (dec_frames[i])
-        av_frame_free(&dec_frames[i]);
+  if (frame_slots) {
+    for (int i = 0; i < frame_slots_cnt; i++) {
+      if (frame_slots[i].frame)
+        av_frame_free(&frame_slots[i].frame);
     }
+    free(frame_slots);
+    frame_slots = NULL;
+  }
+  if (drop_frame)
+    av_frame_free(&drop_frame);
+  if (packet_pool) {
+    av_buffer_pool_uninit(&packet_pool);
+    packet_pool_size = 0;
   }
+  if (frame_pool) {
+    av_buffer_pool_uninit(&frame_pool);
+    frame_pool_size = 0;
+  }
+}
+
+static FRAME_SLOT* ffmpeg_find_slot(const AVFrame* frame) {
+  for (int i = 0; i < frame_slots_cnt; i++) {
+    if (frame_slots[i].frame == frame)
+      return &frame_slots[i];
+  }
+
+  return NULL;
+}
+
+static FRAME_SLOT* ffmpeg_claim_slot(void) {
+  for (int i = 0; i < frame_slots_cnt; i++) {
+    bool expected = true;
+    if (__atomic_compare_exchange_n(&frame_slots[i].free, &expected, false, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      frame_slots[i].refs = 1;
+      int in_use = __atomic_add_fetch(&frames_in_use, 1, __ATOMIC_RELAXED);
+      if (in_use > frame_stats.peak_in_use)
+        frame_stats.peak_in_use = in_use;
+
+      return &frame_slots[i];
+    }
+  }
+
+  return NULL;
+}
+
+void ffmpeg_acquire_frame(AVFrame* frame) {
+  FRAME_SLOT* slot = ffmpeg_find_slot(frame);
+  if (slot)
+    __atomic_add_fetch(&slot->refs, 1, __ATOMIC_RELAXED);
+}
+
+void ffmpeg_release_frame(AVFrame* frame) {
+  FRAME_SLOT* slot = ffmpeg_find_slot(frame);
+  if (slot == NULL || __atomic_sub_fetch(&slot->refs, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+
+  // Drop the decoder buffers before the slot can be claimed again
+  av_frame_unref(slot->frame);
+  __atomic_sub_fetch(&frames_in_use, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->free, true, __ATOMIC_RELEASE);
+}
+
+void ffmpeg_get_frame_stats(PFFMPEG_FRAME_STATS stats) {
+  stats->pool_size = frame_stats.pool_size;
+  stats->peak_in_use = __atomic_load_n(&frame_stats.peak_in_use, __ATOMIC_RELAXED);
+  stats->received = __atomic_load_n(&frame_stats.received, __ATOMIC_RELAXED);
+  stats->exhausted = __atomic_load_n(&frame_stats.exhausted, __ATOMIC_RELAXED);
 }
 
 AVFrame* ffmpeg_get_frame(bool native_frame) {
-  int err = avcodec_receive_frame(decoder_ctx, dec_frames[next_frame]);
+  FRAME_SLOT* slot = ffmpeg_claim_slot();
+
+  // Every frame is still held by the renderer, drain the decoder anyway so it
+  // doesn't stall and drop the frame
+  AVFrame* frame = slot ? slot->frame : drop_frame;
+  uint64_t start = latency_now_us();
+  int err = avcodec_receive_frame(decoder_ctx, frame);
   if (err == 0) {
-    current_frame = next_frame;
-    next_frame = (current_frame+1) % dec_frames_cnt;
+    __atomic_fetch_add(&frame_stats.received, 1, __ATOMIC_RELAXED);
+    latency_record_since(LATENCY_RECEIVE_FRAME, start);
+    // The submit path stores the host receive time as timestamp
+    if (frame->pts != AV_NOPTS_VALUE)
+      latency_record_host(LATENCY_DECODED, frame->pts);
+    ffmpeg_track_receive(frame->pts);
+
+    // The decoder works, remember it for the next start
+    if (first_frame_pending) {
+      first_frame_pending = false;
+      int64_t first_frame_latency = ffmpeg_time_us() - first_packet_time;
+      printf("First frame decoded %.1f ms after the first packet\n", first_frame_latency / 1000.0);
+      decoder_cache_store(decoder_cache_key, decoder->name, open_latency, first_frame_latency);
+    }
+    if (slot == NULL) {
+      __atomic_fetch_add(&frame_stats.exhausted, 1, __ATOMIC_RELAXED);
+      av_frame_unref(drop_frame);
+      return NULL;
+    }
 
     if (ffmpeg_decoder == SOFTWARE || native_frame)
-      return dec_frames[current_frame];
-  } else if (err != AVERROR(EAGAIN)) {
+      return frame;
+  } else if (err != AVERROR(EAGAIN) && err != AVERROR_EOF) {
     char errorstring[512];
     av_strerror(err, errorstring, sizeof(errorstring));
     fprintf(stderr, "Receive failed - %d/%s\n", err, errorstring);
+    receive_failed = true;
   }
+
+  if (slot)
+    ffmpeg_release_frame(frame);
+
   return NULL;
 }
 
+void ffmpeg_flush(void) {
+  int err = avcodec_send_packet(decoder_ctx, NULL);
+  if (err < 0 && err != AVERROR_EOF) {
+    char errorstring[512];
+    av_strerror(err, errorstring, sizeof(errorstring));
+    fprintf(stderr, "Flushing the decoder failed - %s\n", errorstring);
+  }
+}
+
+void ffmpeg_set_colorspace(AVFrame* frame, int colorspace) {
+  // Renderers pick their conversion tables from the frame
+  switch (colorspace) {
+  case COLORSPACE_REC_709:
+    frame->colorspace = AVCOL_SPC_BT709;
+    break;
+  case COLORSPACE_REC_2020:
+    frame->colorspace = AVCOL_SPC_BT2020_NCL;
+    break;
+  default:
+    frame->colorspace = AVCOL_SPC_SMPTE170M;
+    break;
+  }
+}
+
 // packets must be decoded in order
 // indata must be inlen + AV_INPUT_BUFFER_PADDING_SIZE in length
 int ffmpeg_decode(unsigned char* indata, int inlen) {
@@ -197,7 +657,12 @@ int ffmpeg_decode(unsigned char* indata, int inlen) {
   pkt->data = indata;
   pkt->size = inlen;
 
+  int64_t start = ffmpeg_time_us();
+  if (first_packet_time == 0)
+    first_packet_time = start;
+
   err = avcodec_send_packet(decoder_ctx, pkt);
+  latency_record_since(LATENCY_SEND_PACKET, start);
   if (err < 0) {
     char errorstring[512];
     av_strerror(err, errorstring, sizeof(errorstring));
@@ -206,3 +671,154 @@ int ffmpeg_decode(unsigned char* indata, int inlen) {
 
   return err < 0 ? err : 0;
 }
+
+// Copy all entries of a decode unit into a single padded buffer.
+// The returned reference must be passed to ffmpeg_submit_decode_unit
+// or released with av_buffer_unref.
+AVBufferRef* ffmpeg_gather_decode_unit(PDECODE_UNIT decodeUnit) {
+  if (decodeUnit->fullLength > packet_pool_size) {
+    // Buffers still in flight keep the old pool alive until they are released
+    if (packet_pool)
+      av_buffer_pool_uninit(&packet_pool);
+
+    packet_pool_size = FFALIGN(decodeUnit->fullLength, INITIAL_DECODER_BUFFER_SIZE);
+    packet_pool = av_buffer_pool_init(packet_pool_size + AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+    if (packet_pool == NULL) {
+      fprintf(stderr, "Couldn't allocate packet pool\n");
+      packet_pool_size = 0;
+      return NULL;
+    }
+  }
+
+  AVBufferRef* buffer = av_buffer_pool_get(packet_pool);
+  if (buffer == NULL)
+    return NULL;
+
+  int length = 0;
+  for (PLENTRY entry = decodeUnit->bufferList; entry != NULL; entry = entry->next) {
+    neon_memcpy(buffer->data+length, entry->data, entry->length);
+    length += entry->length;
+  }
+  memset(buffer->data+length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+  __atomic_fetch_add(&submit_stats.bytes_copied, length, __ATOMIC_RELAXED);
+
+  return buffer;
+}
+
+static int ffmpeg_request_idr(uint64_t* reason) {
+  __atomic_fetch_add(reason, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&drop_stats.idr_requests, 1, __ATOMIC_RELAXED);
+  backlog_units = 0;
+  return DR_NEED_IDR;
+}
+
+// Returns true when the unit should be dropped because latency keeps building up
+static bool ffmpeg_overloaded(PDECODE_UNIT decodeUnit) {
+  if (frame_budget == 0)
+    return false;
+
+  // Shed the cheapest frames first
+  if (!skipping_nonref && decode_time > frame_budget) {
+    skipping_nonref = true;
+    decoder_ctx->skip_frame = AVDISCARD_NONREF;
+  } else if (skipping_nonref && decode_time < frame_budget * 3 / 4) {
+    skipping_nonref = false;
+    decoder_ctx->skip_frame = AVDISCARD_DEFAULT;
+  }
+
+  if (skipping_nonref)
+    __atomic_fetch_add(&drop_stats.nonref_skipping, 1, __ATOMIC_RELAXED);
+
+  // Never drop the frame that recovers the stream
+  if (decodeUnit->frameType == FRAME_TYPE_IDR) {
+    backlog_units = 0;
+    return false;
+  }
+
+  int64_t lag = (int64_t) (LiGetMillis() - decodeUnit->receiveTimeMs) * 1000;
+  if (lag <= BACKLOG_FRAMES * frame_budget) {
+    backlog_units = 0;
+    return false;
+  }
+
+  return ++backlog_units >= BACKLOG_UNITS;
+}
+
+// Submit a decode unit to the decoder without copying it whenever possible.
+// When buffer is set the unit must consist of a single entry pointing into
+// it and ownership of the buffer is transferred to the decoder.
+int ffmpeg_submit_decode_unit(PDECODE_UNIT decodeUnit, AVBufferRef* buffer) {
+  PLENTRY entry = decodeUnit->bufferList;
+  int err;
+
+  __atomic_fetch_add(&submit_stats.units, 1, __ATOMIC_RELAXED);
+
+  // Decoding after an error or with a growing backlog only adds corrupted or
+  // late frames, drop the unit and wait for the next IDR frame instead
+  if (receive_failed) {
+    receive_failed = false;
+    av_buffer_unref(&buffer);
+    return ffmpeg_request_idr(&drop_stats.decode_errors);
+  }
+  if (ffmpeg_overloaded(decodeUnit)) {
+    av_buffer_unref(&buffer);
+    return ffmpeg_request_idr(&drop_stats.backlog);
+  }
+
+  if (buffer != NULL) {
+    // Already in a padded buffer, the decoder only takes a reference
+    pkt->buf = buffer;
+    pkt->data = (uint8_t*) entry->data;
+    pkt->size = entry->length;
+    __atomic_fetch_add(&submit_stats.bytes_referenced, entry->length, __ATOMIC_RELAXED);
+  } else if (entry->next == NULL) {
+    // Unpadded and not reference counted, libavcodec makes its own padded
+    // copy so gathering first would only copy the data twice
+    pkt->data = (uint8_t*) entry->data;
+    pkt->size = entry->length;
+    __atomic_fetch_add(&submit_stats.bytes_copied, entry->length, __ATOMIC_RELAXED);
+  } else {
+    pkt->buf = ffmpeg_gather_decode_unit(decodeUnit);
+    if (pkt->buf == NULL)
+      return ffmpeg_request_idr(&drop_stats.decode_errors);
+
+    pkt->data = pkt->buf->data;
+    pkt->size = decodeUnit->fullLength;
+    __atomic_fetch_add(&submit_stats.bytes_referenced, decodeUnit->fullLength, __ATOMIC_RELAXED);
+  }
+
+  // Carried over to the decoded frame to measure latency per frame and
+  // to pace presenting it on the host's timeline
+  pkt->pts = decodeUnit->receiveTimeMs;
+  pkt->dts = decodeUnit->presentationTimeMs;
+
+  int64_t start = ffmpeg_time_us();
+  if (first_packet_time == 0)
+    first_packet_time = start;
+
+  err = avcodec_send_packet(decoder_ctx, pkt);
+  latency_record_since(LATENCY_SEND_PACKET, start);
+  if (err >= 0)
+    ffmpeg_track_send(pkt->pts, start);
+  av_packet_unref(pkt);
+
+  if (err < 0) {
+    char errorstring[512];
+    av_strerror(err, errorstring, sizeof(errorstring));
+    fprintf(stderr, "Decode failed - %s\n", errorstring);
+    return ffmpeg_request_idr(&drop_stats.decode_errors);
+  }
+
+  return DR_OK;
+}
+
+void ffmpeg_get_submit_stats(PFFMPEG_SUBMIT_STATS stats) {
+  *stats = submit_stats;
+}
+
+void ffmpeg_get_drop_stats(PFFMPEG_DROP_STATS stats) {
+  stats->nonref_skipping = __atomic_load_n(&drop_stats.nonref_skipping, __ATOMIC_RELAXED);
+  stats->backlog = __atomic_load_n(&drop_stats.backlog, __ATOMIC_RELAXED);
+  stats->decode_errors = __atomic_load_n(&drop_stats.decode_errors, __ATOMIC_RELAXED);
+  stats->idr_requests = __atomic_load_n(&drop_stats.idr_requests, __ATOMIC_RELAXED);
+}
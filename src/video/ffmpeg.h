@@ -17,22 +17,95 @@
  * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <Limelight.h>
+
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <libavcodec/avcodec.h>
 
 // Enable multi-threaded decoding
 #define SLICE_THREADING 0x4
+// Decode several frames in parallel, adds a frame of latency per extra thread
+#define FRAME_THREADING 0x10
+// Allocate software frames in one buffer laid out like a YV12 texture
+#define CONTIGUOUS_FRAMES 0x8
 // Uses hardware acceleration
 #define VDPAU_ACCELERATION 0x40
 #define VAAPI_ACCELERATION 0x80
 
+#define MAX_DECODE_THREADS 4
+
 enum decoders {SOFTWARE, VDPAU, VAAPI};
 extern enum decoders ffmpeg_decoder;
 
+// bytes_copied counts every copy on the way to the decoder, ours as well as
+// the one libavcodec makes of packets that aren't reference counted.
+// bytes_referenced were handed over in a padded buffer, so the decoder
+// didn't copy them again.
+typedef struct _FFMPEG_SUBMIT_STATS {
+  uint64_t units;
+  uint64_t bytes_copied;
+  uint64_t bytes_referenced;
+} FFMPEG_SUBMIT_STATS, *PFFMPEG_SUBMIT_STATS;
+
+typedef struct _FFMPEG_FRAME_STATS {
+  int pool_size;
+  int peak_in_use;
+  uint64_t received;
+  uint64_t exhausted;
+} FFMPEG_FRAME_STATS, *PFFMPEG_FRAME_STATS;
+
+// Decode units dropped or degraded by the overload controller, by reason
+typedef struct _FFMPEG_DROP_STATS {
+  uint64_t nonref_skipping;
+  uint64_t backlog;
+  uint64_t decode_errors;
+  uint64_t idr_requests;
+} FFMPEG_DROP_STATS, *PFFMPEG_DROP_STATS;
+
+// Directory to remember the working decoder in, must be set before ffmpeg_init
+void ffmpeg_set_cache_dir(const char* dir);
+
+// buffer_count is the number of decoded frames the renderer may hold at once
 int ffmpeg_init(int videoFormat, int width, int height, int perf_lvl, int buffer_count, int thread_count);
 void ffmpeg_destroy(void);
 
+// Number of decoder threads worth using, based on the online cores
+int ffmpeg_decode_threads(void);
+
+// Frame interval the overload controller measures decode time against,
+// call after ffmpeg_init
+void ffmpeg_set_frame_rate(int fps);
+
+// Skip the loop filter and allow non spec compliant speedups as soon as
+// decoding a frame takes longer than the frame interval
+void ffmpeg_enable_fast_decode(void);
+
+// Moving average of the time it takes to decode a frame in microseconds
+int64_t ffmpeg_get_decode_time(void);
+
 int ffmpeg_draw_frame(AVFrame *pict);
+// Returns a frame from the pool with one reference owned by the caller,
+// which has to be given back with ffmpeg_release_frame
 AVFrame* ffmpeg_get_frame(bool native_frame);
+void ffmpeg_acquire_frame(AVFrame* frame);
+void ffmpeg_release_frame(AVFrame* frame);
+void ffmpeg_get_frame_stats(PFFMPEG_FRAME_STATS stats);
+// Ends the stream, ffmpeg_get_frame then returns the frames the decoder
+// still holds until it returns NULL
+void ffmpeg_flush(void);
+// Tags a frame with the COLORSPACE_* the host signalled for its decode unit
+void ffmpeg_set_colorspace(AVFrame* frame, int colorspace);
 int ffmpeg_decode(unsigned char* indata, int inlen);
+
+// Returns the height of the YV12 texture with a pitch of linesize[0] the
+// frame is laid out as, or 0 when the planes aren't stored contiguously
+int ffmpeg_contiguous_height(const AVFrame* frame);
+
+AVBufferRef* ffmpeg_gather_decode_unit(PDECODE_UNIT decodeUnit);
+// Returns DR_NEED_IDR when the unit couldn't be decoded or was dropped
+// because decoding fell behind
+int ffmpeg_submit_decode_unit(PDECODE_UNIT decodeUnit, AVBufferRef* buffer);
+void ffmpeg_get_submit_stats(PFFMPEG_SUBMIT_STATS stats);
+void ffmpeg_get_drop_stats(PFFMPEG_DROP_STATS stats);
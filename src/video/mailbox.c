@@ -0,0 +1,224 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mailbox.h"
+#include "ffmpeg.h"
+
+#include "../latency.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+// Bounded frame queue between one producer (decoder) and one consumer
+// (renderer). Frames come from the decoder's frame pool: when the queue
+// is full the producer releases the oldest waiting frame, the consumer
+// keeps the frame it displays until it takes the next one. The lock is
+// only held to move pointers, so neither side ever waits on the other
+// and a frame is never reused while it's displayed.
+//
+// With a depth of one, which all but smooth pacing use, frames go through
+// a lock-free triple buffer instead. The producer fills its back entry,
+// the consumer shows the frame of its front entry and the third entry is
+// the mailbox itself. Entries are swapped with an atomic exchange.
+
+#define SLOT_ENTRIES 3
+#define SLOT_INDEX_MASK 0x3
+#define SLOT_FRESH 0x4
+
+typedef struct {
+  AVFrame* frame;
+  uint64_t queued_us;
+} MAILBOX_ENTRY;
+
+static MAILBOX_ENTRY queue[MAILBOX_MAX_DEPTH];
+static int depth, head, count;
+static AVFrame* front;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static MAILBOX_ENTRY slots[SLOT_ENTRIES];
+static int back_slot, front_slot, latest;
+
+static uint64_t submitted, superseded, presented;
+
+int mailbox_init(int queue_depth) {
+  if (queue_depth < 1 || queue_depth > MAILBOX_MAX_DEPTH)
+    return -1;
+
+  depth = queue_depth;
+  head = count = 0;
+  front = NULL;
+
+  for (int i = 0; i < SLOT_ENTRIES; i++)
+    slots[i].frame = NULL;
+  back_slot = 0;
+  latest = 1;
+  front_slot = 2;
+  submitted = superseded = presented = 0;
+
+  return 0;
+}
+
+void mailbox_destroy(void) {
+  pthread_mutex_lock(&lock);
+  for (; count > 0; count--) {
+    ffmpeg_release_frame(queue[head].frame);
+    head = (head + 1) % depth;
+  }
+  pthread_mutex_unlock(&lock);
+
+  if (front) {
+    ffmpeg_release_frame(front);
+    front = NULL;
+  }
+
+  for (int i = 0; i < SLOT_ENTRIES; i++) {
+    if (slots[i].frame) {
+      ffmpeg_release_frame(slots[i].frame);
+      slots[i].frame = NULL;
+    }
+  }
+}
+
+static bool mailbox_put_slot(AVFrame* frame) {
+  slots[back_slot].frame = frame;
+  slots[back_slot].queued_us = latency_now_us();
+
+  int prev = __atomic_exchange_n(&latest, back_slot | SLOT_FRESH, __ATOMIC_ACQ_REL);
+  back_slot = prev & SLOT_INDEX_MASK;
+  __atomic_fetch_add(&submitted, 1, __ATOMIC_RELAXED);
+
+  // The previous frame was never picked up, so a wake-up is still pending
+  if (prev & SLOT_FRESH) {
+    ffmpeg_release_frame(slots[back_slot].frame);
+    slots[back_slot].frame = NULL;
+    __atomic_fetch_add(&superseded, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  return true;
+}
+
+static AVFrame* mailbox_take_slot(uint64_t* queued_us) {
+  // Only the consumer clears the flag, so a fresh frame stays there
+  if (!(__atomic_load_n(&latest, __ATOMIC_ACQUIRE) & SLOT_FRESH))
+    return NULL;
+
+  // The entry goes back to the producer without the frame shown so far
+  if (slots[front_slot].frame) {
+    ffmpeg_release_frame(slots[front_slot].frame);
+    slots[front_slot].frame = NULL;
+  }
+
+  int prev = __atomic_exchange_n(&latest, front_slot, __ATOMIC_ACQ_REL);
+  front_slot = prev & SLOT_INDEX_MASK;
+  if (queued_us)
+    *queued_us = slots[front_slot].queued_us;
+  __atomic_fetch_add(&presented, 1, __ATOMIC_RELAXED);
+
+  return slots[front_slot].frame;
+}
+
+bool mailbox_put(AVFrame* frame) {
+  if (depth == 1)
+    return mailbox_put_slot(frame);
+
+  AVFrame* dropped = NULL;
+
+  pthread_mutex_lock(&lock);
+  if (count == depth) {
+    dropped = queue[head].frame;
+    head = (head + 1) % depth;
+    count--;
+  }
+
+  int tail = (head + count) % depth;
+  queue[tail].frame = frame;
+  queue[tail].queued_us = latency_now_us();
+  bool wake = count++ == 0;
+  pthread_mutex_unlock(&lock);
+
+  __atomic_fetch_add(&submitted, 1, __ATOMIC_RELAXED);
+  if (dropped) {
+    ffmpeg_release_frame(dropped);
+    __atomic_fetch_add(&superseded, 1, __ATOMIC_RELAXED);
+  }
+
+  // Frames were already waiting, so a wake-up is still pending
+  return wake;
+}
+
+bool mailbox_pending(void) {
+  if (depth == 1)
+    return __atomic_load_n(&latest, __ATOMIC_ACQUIRE) & SLOT_FRESH;
+
+  pthread_mutex_lock(&lock);
+  bool pending = count > 0;
+  pthread_mutex_unlock(&lock);
+
+  return pending;
+}
+
+AVFrame* mailbox_peek(uint64_t* queued_us) {
+  AVFrame* frame = NULL;
+
+  // The producer may replace the single slot's frame at any time
+  if (depth == 1)
+    return NULL;
+
+  pthread_mutex_lock(&lock);
+  if (count > 0) {
+    frame = queue[head].frame;
+    if (queued_us)
+      *queued_us = queue[head].queued_us;
+  }
+  pthread_mutex_unlock(&lock);
+
+  return frame;
+}
+
+AVFrame* mailbox_take(uint64_t* queued_us) {
+  if (depth == 1)
+    return mailbox_take_slot(queued_us);
+
+  pthread_mutex_lock(&lock);
+  if (count == 0) {
+    pthread_mutex_unlock(&lock);
+    return NULL;
+  }
+
+  AVFrame* frame = queue[head].frame;
+  if (queued_us)
+    *queued_us = queue[head].queued_us;
+
+  head = (head + 1) % depth;
+  count--;
+  pthread_mutex_unlock(&lock);
+
+  if (front)
+    ffmpeg_release_frame(front);
+
+  front = frame;
+  __atomic_fetch_add(&presented, 1, __ATOMIC_RELAXED);
+
+  return frame;
+}
+
+void mailbox_get_stats(PMAILBOX_STATS stats) {
+  stats->submitted = __atomic_load_n(&submitted, __ATOMIC_RELAXED);
+  stats->superseded = __atomic_load_n(&superseded, __ATOMIC_RELAXED);
+  stats->presented = __atomic_load_n(&presented, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <libavcodec/avcodec.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Deepest queue a pacing policy may ask for
+#define MAILBOX_MAX_DEPTH 4
+
+typedef struct _MAILBOX_STATS {
+  uint64_t submitted;
+  uint64_t superseded;
+  uint64_t presented;
+} MAILBOX_STATS, *PMAILBOX_STATS;
+
+// queue_depth is the number of decoded frames waiting to be presented
+// before the oldest one is dropped, the renderer holds one more
+int mailbox_init(int queue_depth);
+void mailbox_destroy(void);
+
+// Producer side, takes over the caller's reference to a frame acquired
+// from the decoder's frame pool. Returns true when the consumer has to
+// be woken up.
+bool mailbox_put(AVFrame* frame);
+
+// Consumer side, true when a frame waits to be taken
+bool mailbox_pending(void);
+
+// Consumer side, returns the oldest waiting frame without taking it or
+// NULL when the queue is empty. queued_us receives the latency_now_us
+// time the frame was queued at and may be NULL. Only for queues deeper
+// than one, a single frame may be replaced at any time and NULL is
+// returned.
+AVFrame* mailbox_peek(uint64_t* queued_us);
+
+// Consumer side, returns the oldest waiting frame or NULL when nothing
+// new arrived. The frame stays valid until the next call to mailbox_take,
+// which releases it back to the pool.
+AVFrame* mailbox_take(uint64_t* queued_us);
+
+void mailbox_get_stats(PMAILBOX_STATS stats);
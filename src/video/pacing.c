@@ -0,0 +1,184 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pacing.h"
+#include "mailbox.h"
+
+#include "../latency.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Frames queued by the smooth policy before the oldest is dropped
+#define SMOOTH_QUEUE_DEPTH 3
+// Frame intervals the jitter buffer holds frames for at least
+#define SMOOTH_BUFFER_FRAMES 1
+// The buffer shrinks by 1/2^SMOOTH_DECAY_SHIFT of its excess per frame
+#define SMOOTH_DECAY_SHIFT 4
+// Larger jumps of the host timeline restart the jitter buffer
+#define SMOOTH_RESYNC_US 1000000
+// Longer present intervals are stalls, not jitter
+#define STALL_FRAMES 4
+
+static const char* policy_names[] = {
+  [PACING_LOWEST_LATENCY] = "lowest latency",
+  [PACING_BALANCED] = "balanced",
+  [PACING_SMOOTH] = "smooth",
+};
+
+static enum pacing policy;
+static int64_t frame_interval_us, buffer_us;
+
+// Host presentation time plus offset is the local time a frame is due at
+static int64_t offset_us;
+static bool synced;
+
+static uint64_t taken_queued_us, last_present_us;
+static uint64_t presented, late, intervals;
+static uint64_t jitter_total, jitter_max, added_total, added_max;
+
+int pacing_queue_depth(enum pacing policy) {
+  return policy == PACING_SMOOTH ? SMOOTH_QUEUE_DEPTH : 1;
+}
+
+void pacing_init(enum pacing pacing_policy, int fps) {
+  policy = pacing_policy;
+  frame_interval_us = 1000000 / (fps > 0 ? fps : 60);
+  buffer_us = frame_interval_us * SMOOTH_BUFFER_FRAMES;
+
+  synced = false;
+  taken_queued_us = last_present_us = 0;
+  presented = late = intervals = 0;
+  jitter_total = jitter_max = added_total = added_max = 0;
+}
+
+// frame->pkt_dts carries the host presentation time in milliseconds
+static int64_t pacing_due_us(AVFrame* frame) {
+  return frame->pkt_dts * 1000 + offset_us;
+}
+
+int pacing_timeout(void) {
+  if (policy != PACING_SMOOTH)
+    return mailbox_pending() ? 0 : -1;
+
+  AVFrame* frame = mailbox_peek(NULL);
+  if (frame == NULL)
+    return -1;
+
+  if (!synced || frame->pkt_dts == AV_NOPTS_VALUE)
+    return 0;
+
+  int64_t wait_us = pacing_due_us(frame) - (int64_t) latency_now_us();
+  if (wait_us <= 0 || wait_us > SMOOTH_RESYNC_US)
+    return 0;
+
+  // Round up, waking early would only wait again
+  return (wait_us + 999) / 1000;
+}
+
+// The offset follows the latest arrival plus the buffer right away, so
+// a late frame grows the buffer, and decays slowly once frames arrive
+// earlier again
+static void pacing_adapt(AVFrame* frame, uint64_t queued_us) {
+  int64_t target = (int64_t) queued_us - frame->pkt_dts * 1000 + buffer_us;
+
+  if (!synced || target - offset_us > SMOOTH_RESYNC_US || offset_us - target > SMOOTH_RESYNC_US) {
+    offset_us = target;
+    synced = true;
+  } else if (target > offset_us) {
+    // Only frames queued after their due time count as late
+    if (target - offset_us > buffer_us)
+      late++;
+
+    offset_us = target;
+  } else
+    offset_us -= (offset_us - target) >> SMOOTH_DECAY_SHIFT;
+}
+
+AVFrame* pacing_next_frame(void) {
+  uint64_t queued_us;
+
+  if (policy == PACING_SMOOTH) {
+    AVFrame* frame = mailbox_peek(&queued_us);
+    if (frame == NULL)
+      return NULL;
+
+    if (frame->pkt_dts != AV_NOPTS_VALUE) {
+      // The first frame waits for the buffer like every other one
+      if (!synced)
+        pacing_adapt(frame, queued_us);
+
+      int64_t wait_us = pacing_due_us(frame) - (int64_t) latency_now_us();
+      if (wait_us > 0 && wait_us <= SMOOTH_RESYNC_US)
+        return NULL;
+    }
+  }
+
+  AVFrame* frame = mailbox_take(&queued_us);
+  if (frame == NULL)
+    return NULL;
+
+  if (policy == PACING_SMOOTH && frame->pkt_dts != AV_NOPTS_VALUE)
+    pacing_adapt(frame, queued_us);
+
+  taken_queued_us = queued_us;
+  return frame;
+}
+
+void pacing_presented(void) {
+  uint64_t now = latency_now_us();
+
+  uint64_t added = now - taken_queued_us;
+  latency_record(LATENCY_QUEUED, added);
+  added_total += added;
+  if (added > added_max)
+    added_max = added;
+
+  if (last_present_us != 0 && now - last_present_us < (uint64_t) frame_interval_us * STALL_FRAMES) {
+    uint64_t jitter = llabs((int64_t) (now - last_present_us) - frame_interval_us);
+    jitter_total += jitter;
+    if (jitter > jitter_max)
+      jitter_max = jitter;
+
+    intervals++;
+  }
+
+  last_present_us = now;
+  presented++;
+}
+
+void pacing_get_stats(PPACING_STATS stats) {
+  stats->presented = presented;
+  stats->late = late;
+  stats->jitter_mean = intervals > 0 ? jitter_total / intervals : 0;
+  stats->jitter_max = jitter_max;
+  stats->added_mean = presented > 0 ? added_total / presented : 0;
+  stats->added_max = added_max;
+}
+
+void pacing_print_stats(void) {
+  PACING_STATS stats;
+  pacing_get_stats(&stats);
+
+  printf("Pacing %s: %llu frames, display jitter %.1f ms average %.1f ms max, added latency %.1f ms average %.1f ms max",
+         policy_names[policy], (unsigned long long) stats.presented, stats.jitter_mean / 1000.0, stats.jitter_max / 1000.0,
+         stats.added_mean / 1000.0, stats.added_max / 1000.0);
+  if (policy == PACING_SMOOTH)
+    printf(", %llu late frames", (unsigned long long) stats.late);
+
+  printf("\n");
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../platform.h"
+#include "../config.h"
+
+#include <libavcodec/avcodec.h>
+
+#include <stdint.h>
+
+typedef struct _PACING_STATS {
+  uint64_t presented;
+  uint64_t late;
+  uint64_t jitter_mean;
+  uint64_t jitter_max;
+  uint64_t added_mean;
+  uint64_t added_max;
+} PACING_STATS, *PPACING_STATS;
+
+// Number of decoded frames the policy queues ahead of the displayed one
+int pacing_queue_depth(enum pacing policy);
+
+// Call before the first frame is queued, clears the statistics
+void pacing_init(enum pacing policy, int fps);
+
+// Milliseconds until the next queued frame is due, -1 when none is queued
+int pacing_timeout(void);
+
+// Frame to present now or NULL, valid until the next call
+AVFrame* pacing_next_frame(void);
+
+// Call once the frame returned by pacing_next_frame is on screen
+void pacing_presented(void);
+
+// Display jitter is the deviation of present intervals from the frame
+// interval, added latency the time from queueing until presenting a frame
+// and late the frames the smooth jitter buffer had to grow for
+void pacing_get_stats(PPACING_STATS stats);
+void pacing_print_stats(void);
@@ -20,6 +20,7 @@
 
 #include "video.h"
 #include "../util.h"
+#include "../latency.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -629,6 +630,7 @@ int rk_submit_decode_unit(PDECODE_UNIT decodeUnit) {
   PLENTRY entry = decodeUnit->bufferList;
   int length = 0;
 
+  latency_record_host(LATENCY_SUBMIT, decodeUnit->receiveTimeMs);
   if (ensure_buf_size(&pkt_buf, &pkt_buf_size, decodeUnit->fullLength)) {
     // Buffer was reallocated, so update the mpp_packet accordingly
     mpp_packet_set_data(mpi_packet, pkt_buf);
@@ -719,7 +721,9 @@ int rk_submit_decode_unit(PDECODE_UNIT decodeUnit) {
   last_colorspace = decodeUnit->colorspace;
   last_hdr_state = decodeUnit->hdrActive;
 
+  uint64_t start = latency_now_us();
   while (MPP_OK != mpi_api->decode_put_packet(mpi_ctx, mpi_packet));
+  latency_record_since(LATENCY_SEND_PACKET, start);
 
   return result;
 }
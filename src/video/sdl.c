@@ -19,69 +19,133 @@
 
 #include "video.h"
 #include "ffmpeg.h"
+#include "decode_queue.h"
+#include "mailbox.h"
+#include "pacing.h"
 
 #include "../sdl.h"
 #include "../util.h"
+#include "../latency.h"
+#include "../platform.h"
+#include "../config.h"
 
 #include <SDL.h>
 #include <SDL_thread.h>
 
 #include <unistd.h>
 #include <stdbool.h>
+#include <string.h>
 
-#define SLICES_PER_FRAME 4
+static bool use_decode_queue;
+static int decode_threads;
+static SDL_VIDEO_STATS video_stats;
 
-static void* ffmpeg_buffer;
-static size_t ffmpeg_buffer_size;
+static int sdl_decode_unit(PDECODE_UNIT decodeUnit, AVBufferRef* buffer);
+
+void sdl_video_prepare(void) {
+  decode_threads = ffmpeg_decode_threads();
+
+  // Have the host split frames into one slice per decoder thread
+  decoder_callbacks_sdl.capabilities &= ~CAPABILITY_SLICES_PER_FRAME(0xFF);
+  decoder_callbacks_sdl.capabilities |= CAPABILITY_SLICES_PER_FRAME(decode_threads);
+}
 
 static int sdl_setup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) {
-  if (ffmpeg_init(videoFormat, width, height, SLICE_THREADING, SDL_BUFFER_FRAMES, SLICES_PER_FRAME) < 0) {
+  if (decode_threads == 0)
+    decode_threads = ffmpeg_decode_threads();
+
+  // AV1 frames aren't sliced by the host, decode whole frames in parallel instead
+  int perf_lvl = 0;
+  if (decode_threads > 1)
+    perf_lvl |= videoFormat & VIDEO_FORMAT_MASK_AV1 ? FRAME_THREADING : SLICE_THREADING;
+
+  // SDL uploads the YUV texture itself, let the decoder write frames in the texture layout
+  if (config.scaler == SCALER_SDL)
+    perf_lvl |= CONTIGUOUS_FRAMES;
+
+  // The renderer holds the displayed frame on top of the queued ones
+  int queue_depth = pacing_queue_depth(config.pacing);
+
+  memset(&video_stats, 0, sizeof(video_stats));
+  ffmpeg_set_cache_dir(config.key_dir);
+  if (ffmpeg_init(videoFormat, width, height, perf_lvl, queue_depth + 1, decode_threads) < 0) {
     fprintf(stderr, "Couldn't initialize video decoding\n");
     return -1;
   }
 
-  ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, INITIAL_DECODER_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE);
+  printf("Decoding with %d %s thread%s\n", decode_threads, perf_lvl & FRAME_THREADING ? "frame" : "slice", decode_threads > 1 ? "s" : "");
+  ffmpeg_set_frame_rate(redrawRate);
+  if (config.fast_decode)
+    ffmpeg_enable_fast_decode();
+
+  if (mailbox_init(queue_depth) < 0) {
+    fprintf(stderr, "Couldn't initialize frame mailbox\n");
+    return -1;
+  }
+  pacing_init(config.pacing, redrawRate);
+
+  use_decode_queue = config.decode_queue > 0;
+  if (use_decode_queue && decode_queue_init(config.decode_queue, sdl_decode_unit) < 0) {
+    fprintf(stderr, "Couldn't start decode thread\n");
+    return -1;
+  }
 
   return 0;
 }
 
 static void sdl_cleanup() {
-  ffmpeg_destroy();
-}
+  if (use_decode_queue) {
+    DECODE_QUEUE_STATS queue_stats;
+    decode_queue_get_stats(&queue_stats);
+    printf("Decode queue: %llu queued, %llu dropped, %llu overflows, peak occupancy %d/%d\n", (unsigned long long) queue_stats.enqueued, (unsigned long long) queue_stats.dropped, (unsigned long long) queue_stats.overflows, queue_stats.peak_occupancy, queue_stats.depth);
+    decode_queue_destroy();
+  }
 
-static int sdl_submit_decode_unit(PDECODE_UNIT decodeUnit) {
-  PLENTRY entry = decodeUnit->bufferList;
-  int length = 0;
+  MAILBOX_STATS stats;
+  mailbox_get_stats(&stats);
+  printf("Frames: %llu decoded, %llu presented, %llu superseded\n", (unsigned long long) stats.submitted, (unsigned long long) stats.presented, (unsigned long long) stats.superseded);
 
-  ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, decodeUnit->fullLength + AV_INPUT_BUFFER_PADDING_SIZE);
+  mailbox_destroy();
+  ffmpeg_destroy();
+}
 
-  while (entry != NULL) {
-    neon_memcpy(ffmpeg_buffer+length, entry->data, entry->length);
-    length += entry->length;
-    entry = entry->next;
-  }
-  ffmpeg_decode(ffmpeg_buffer, length);
+static int sdl_decode_unit(PDECODE_UNIT decodeUnit, AVBufferRef* buffer) {
+  int ret = ffmpeg_submit_decode_unit(decodeUnit, buffer);
 
-  SDL_LockMutex(mutex);
   AVFrame* frame = ffmpeg_get_frame(false);
-  if (frame != NULL) {
-    sdlNextFrame++;
+  if (frame != NULL)
+    ffmpeg_set_colorspace(frame, decodeUnit->colorspace);
 
+  if (frame != NULL && mailbox_put(frame)) {
+    // Only wake up the renderer when the queue was empty, it presents
+    // frames already waiting according to the pacing policy
     SDL_Event event;
     event.type = SDL_USEREVENT;
     event.user.code = SDL_CODE_FRAME;
-    event.user.data1 = &frame->data;
-    event.user.data2 = &frame->linesize;
     SDL_PushEvent(&event);
   }
-  SDL_UnlockMutex(mutex);
 
-  return DR_OK;
+  return ret;
+}
+
+static int sdl_submit_decode_unit(PDECODE_UNIT decodeUnit) {
+  latency_record_host(LATENCY_SUBMIT, decodeUnit->receiveTimeMs);
+  __atomic_fetch_add(&video_stats.received_units, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&video_stats.received_bytes, decodeUnit->fullLength, __ATOMIC_RELAXED);
+  if (use_decode_queue)
+    return decode_queue_submit(decodeUnit);
+
+  return sdl_decode_unit(decodeUnit, NULL);
+}
+
+void sdl_video_get_stats(PSDL_VIDEO_STATS stats) {
+  stats->received_units = __atomic_load_n(&video_stats.received_units, __ATOMIC_RELAXED);
+  stats->received_bytes = __atomic_load_n(&video_stats.received_bytes, __ATOMIC_RELAXED);
 }
 
 DECODER_RENDERER_CALLBACKS decoder_callbacks_sdl = {
   .setup = sdl_setup,
   .cleanup = sdl_cleanup,
   .submitDecodeUnit = sdl_submit_decode_unit,
-  .capabilities = CAPABILITY_SLICES_PER_FRAME(SLICES_PER_FRAME) | CAPABILITY_REFERENCE_FRAME_INVALIDATION_HEVC | CAPABILITY_DIRECT_SUBMIT,
+  .capabilities = CAPABILITY_SLICES_PER_FRAME(MAX_DECODE_THREADS) | CAPABILITY_REFERENCE_FRAME_INVALIDATION_HEVC | CAPABILITY_DIRECT_SUBMIT,
 };
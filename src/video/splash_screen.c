@@ -1,97 +1,113 @@
-#include <SDL2/SDL.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <png.h>
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "splash_screen.h"
 #include "../sdl.h"
 
-SDL_Texture* nextFrame = NULL;
-int nextFrameNumber = 0;
-const char* image_path;
-int debugging = 0;
-
-extern SDL_Renderer *renderer;
-extern SDL_Window *window;
+#include <SDL.h>
 
-int load_next_frame(void* data) {
-    if (debugging) {
-        fprintf(stderr, "Entering load_next_frame\n");
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Plays the splash pack through one streaming texture, frames are picked by
+// wall clock time so a slow present skips frames instead of stretching the
+// animation. Any key skips the splash, without a pack there is none.
+void sdl_splash(SDLContext *ctx) {
+    int fd = open(SPLASH_PACK, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Splash: no splash pack at %s - %s\n", SPLASH_PACK, strerror(errno));
+        return;
     }
-    char filename[256];
-    snprintf(filename, sizeof(filename), "%s/frame%04d.png", "/mnt/SDCARD/App/moonlight/splash", nextFrameNumber);
 
-    FILE *fp = fopen(filename, "rb");
-    if(!fp) {
-        fprintf(stderr, "File %s could not be opened for reading\n", filename);
-        return 1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(SPLASH_PACK_HEADER)) {
+        close(fd);
+        return;
     }
 
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    png_init_io(png_ptr, fp);
-    png_read_info(png_ptr, info_ptr);
-
-    int width = png_get_image_width(png_ptr, info_ptr);
-    int height = png_get_image_height(png_ptr, info_ptr);
-
-    png_read_update_info(png_ptr, info_ptr);
-    int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    png_byte* image_data;
-    image_data = malloc(rowbytes * height * sizeof(png_byte));
-    png_bytep* row_pointers = malloc(height * sizeof(png_bytep));
-
-    for(int y = 0; y < height; y++) {
-        row_pointers[height - 1 - y] = image_data + y * rowbytes;
+    size_t size = st.st_size;
+    const uint8_t *pack = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pack == MAP_FAILED) {
+        perror("Splash: mmap");
+        return;
     }
 
-    png_read_image(png_ptr, row_pointers);
-    fclose(fp);
-
-    SDL_Surface* frame = SDL_CreateRGBSurfaceFrom((void*)image_data, width, height,
-                                                  32, rowbytes,
-                                                  0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
-
-    nextFrame = SDL_CreateTextureFromSurface(renderer, frame);
-
-    SDL_FreeSurface(frame);
-    free(image_data);
-    free(row_pointers);
-
-    if (debugging) {
-        fprintf(stderr, "Exiting load_next_frame\n");
+    const SPLASH_PACK_HEADER *header = (const SPLASH_PACK_HEADER *) pack;
+    size_t frame_size = (size_t) header->width * header->height * 2;
+    if (header->magic != SPLASH_PACK_MAGIC || header->version != SPLASH_PACK_VERSION || header->frame_ms == 0 ||
+        frame_size == 0 || (size - sizeof(SPLASH_PACK_HEADER)) / frame_size < header->frame_count) {
+        fprintf(stderr, "Splash: %s is not a valid splash pack\n", SPLASH_PACK);
+        munmap((void *) pack, size);
+        return;
     }
-    return 0;
-}
-
-int show_splash() {
-    int frameDuration = 40;
-
-    nextFrameNumber = 1;
-
-    SDL_Thread* thread = SDL_CreateThread(load_next_frame, "load_next_frame", NULL);
-    if (thread == NULL) {
-    fprintf(stderr, "Failed to create thread: %s\n", SDL_GetError());
-    } else {
-    fprintf(stderr, "Thread created successfully.\n");
+    madvise((void *) pack, size, MADV_SEQUENTIAL);
+
+    SDL_Texture *texture = SDL_CreateTexture(ctx->renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING,
+                                             header->width, header->height);
+    if (!texture) {
+        fprintf(stderr, "Splash: could not create texture - %s\n", SDL_GetError());
+        munmap((void *) pack, size);
+        return;
     }
 
-    int i = 1;
-    while (1) {
-    SDL_WaitThread(thread, NULL);
-
-    if (nextFrame == NULL) {
-    break;
+    const uint8_t *frames = pack + sizeof(SPLASH_PACK_HEADER);
+    Uint32 start = SDL_GetTicks();
+    int shown = -1, presented = 0;
+    bool skipped = false;
+    while (!skipped) {
+        Uint32 frame = (SDL_GetTicks() - start) / header->frame_ms;
+        if (frame >= header->frame_count)
+            break;
+
+        if ((int) frame != shown) {
+            SDL_UpdateTexture(texture, NULL, frames + frame * frame_size, header->width * 2);
+            SDL_RenderClear(ctx->renderer);
+            SDL_RenderCopy(ctx->renderer, texture, NULL, NULL);
+            SDL_RenderPresent(ctx->renderer);
+            shown = frame;
+            presented++;
+        }
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                // Left for the menu loop so quitting still works
+                SDL_PushEvent(&event);
+                skipped = true;
+                break;
+            } else if (event.type == SDL_KEYDOWN || event.type == SDL_CONTROLLERBUTTONDOWN) {
+                skipped = true;
+            }
+        }
+
+        Uint32 next = start + (frame + 1) * header->frame_ms;
+        Uint32 now = SDL_GetTicks();
+        if (!skipped && next > now)
+            SDL_Delay(next - now);
     }
 
-    SDL_RenderCopy(renderer, nextFrame, NULL, NULL);
-    SDL_RenderPresent(renderer);
+    printf("Splash: presented %d of %u frames%s\n", presented, header->frame_count, skipped ? ", skipped" : "");
 
-    SDL_DestroyTexture(nextFrame);
-    nextFrame = NULL;
-
-    nextFrameNumber = ++i;
-    thread = SDL_CreateThread(load_next_frame, "load_next_frame", NULL);
-    SDL_Delay(frameDuration);
-    }
-
-    return 0;
-}
\ No newline at end of file
+    SDL_DestroyTexture(texture);
+    munmap((void *) pack, size);
+}
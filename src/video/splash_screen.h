@@ -1,6 +1,35 @@
-#ifndef SPLASH_SCREEN_H
-#define SPLASH_SCREEN_H
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
 
-int show_splash();
+#pragma once
 
-#endif // SPLASH_SCREEN_H
\ No newline at end of file
+#include <stdint.h>
+
+// Splash packs are written by tools/splashpack from a PNG sequence, the
+// header is followed by frame_count frames of width * height RGB565 pixels
+// without any padding so the player can hand them straight to SDL
+#define SPLASH_PACK_MAGIC 0x4b505053
+#define SPLASH_PACK_VERSION 1
+
+typedef struct _SPLASH_PACK_HEADER {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t frame_ms;
+  uint16_t width;
+  uint16_t height;
+  uint32_t frame_count;
+} SPLASH_PACK_HEADER;
@@ -20,6 +20,7 @@
 #include <Limelight.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define DISPLAY_FULLSCREEN 1
 #define ENABLE_HARDWARE_ACCELERATION_1 2
@@ -45,6 +46,18 @@ extern DECODER_RENDERER_CALLBACKS decoder_callbacks_x11_vaapi;
 extern DECODER_RENDERER_CALLBACKS decoder_callbacks_x11_vdpau;
 #endif
 #endif
+#ifdef HAVE_FAKE
+extern DECODER_RENDERER_CALLBACKS decoder_callbacks_fake;
+void fake_video_prepare(void);
+#endif
 #ifdef HAVE_SDL
 extern DECODER_RENDERER_CALLBACKS decoder_callbacks_sdl;
+void sdl_video_prepare(void);
+
+typedef struct _SDL_VIDEO_STATS {
+  uint64_t received_units;
+  uint64_t received_bytes;
+} SDL_VIDEO_STATS, *PSDL_VIDEO_STATS;
+
+void sdl_video_get_stats(PSDL_VIDEO_STATS stats);
 #endif
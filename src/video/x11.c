@@ -20,6 +20,7 @@
 #include "video.h"
 #include "egl.h"
 #include "ffmpeg.h"
+#include "decode_queue.h"
 #ifdef HAVE_VAAPI
 #include "ffmpeg_vaapi.h"
 #endif
@@ -27,6 +28,9 @@
 #include "../input/x11.h"
 #include "../loop.h"
 #include "../util.h"
+#include "../latency.h"
+#include "../platform.h"
+#include "../config.h"
 
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
@@ -41,9 +45,8 @@
 #define X11_VDPAU_ACCELERATION ENABLE_HARDWARE_ACCELERATION_1
 #define X11_VAAPI_ACCELERATION ENABLE_HARDWARE_ACCELERATION_2
 #define SLICES_PER_FRAME 4
-
-static void* ffmpeg_buffer = NULL;
-static size_t ffmpeg_buffer_size = 0;
+// Frames waiting in the pipe plus the one being drawn
+#define X11_BUFFER_FRAMES 3
 
 static Display *display = NULL;
 static Window window;
@@ -53,16 +56,32 @@ static int pipefd[2];
 static int display_width;
 static int display_height;
 
+static bool use_decode_queue;
+
+static int x11_decode_unit(PDECODE_UNIT decodeUnit, AVBufferRef* buffer);
+
 static int frame_handle(int pipefd) {
   AVFrame* frame = NULL;
-  while (read(pipefd, &frame, sizeof(void*)) > 0);
+  AVFrame* next;
+  while (read(pipefd, &next, sizeof(void*)) > 0) {
+    // Only the newest frame is drawn, hand skipped ones back to the pool
+    if (frame)
+      ffmpeg_release_frame(frame);
+    frame = next;
+  }
+
   if (frame) {
+    uint64_t start = latency_now_us();
     if (ffmpeg_decoder == SOFTWARE)
       egl_draw(frame->data);
     #ifdef HAVE_VAAPI
     else if (ffmpeg_decoder == VAAPI)
       vaapi_queue(frame, window, display_width, display_height);
     #endif
+    latency_record_since(LATENCY_PRESENT, start);
+    if (frame->pts != AV_NOPTS_VALUE)
+      latency_record_host(LATENCY_END_TO_END, frame->pts);
+    ffmpeg_release_frame(frame);
   }
 
   return LOOP_OK;
@@ -83,8 +102,6 @@ int x11_init(bool vdpau, bool vaapi) {
 }
 
 int x11_setup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) {
-  ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, INITIAL_DECODER_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE);
-
   if (!display) {
     fprintf(stderr, "Error: failed to open X display.\n");
     return -1;
@@ -130,10 +147,12 @@ int x11_setup(int videoFormat, int width, int height, int redrawRate, void* cont
   else
     avc_flags = SLICE_THREADING;
 
-  if (ffmpeg_init(videoFormat, width, height, avc_flags, 2, SLICES_PER_FRAME) < 0) {
+  ffmpeg_set_cache_dir(config.key_dir);
+  if (ffmpeg_init(videoFormat, width, height, avc_flags, X11_BUFFER_FRAMES, SLICES_PER_FRAME) < 0) {
     fprintf(stderr, "Couldn't initialize video decoding\n");
     return -1;
   }
+  ffmpeg_set_frame_rate(redrawRate);
 
   if (ffmpeg_decoder == SOFTWARE)
     egl_init(display, window, width, height);
@@ -147,6 +166,12 @@ int x11_setup(int videoFormat, int width, int height, int redrawRate, void* cont
 
   x11_input_init(display, window);
 
+  use_decode_queue = config.decode_queue > 0;
+  if (use_decode_queue && decode_queue_init(config.decode_queue, x11_decode_unit) < 0) {
+    fprintf(stderr, "Couldn't start decode thread\n");
+    return -1;
+  }
+
   return 0;
 }
 
@@ -159,29 +184,33 @@ int x11_setup_vaapi(int videoFormat, int width, int height, int redrawRate, void
 }
 
 void x11_cleanup() {
+  if (use_decode_queue) {
+    DECODE_QUEUE_STATS queue_stats;
+    decode_queue_get_stats(&queue_stats);
+    printf("Decode queue: %llu queued, %llu dropped, %llu overflows, peak occupancy %d/%d\n", (unsigned long long) queue_stats.enqueued, (unsigned long long) queue_stats.dropped, (unsigned long long) queue_stats.overflows, queue_stats.peak_occupancy, queue_stats.depth);
+    decode_queue_destroy();
+  }
+
   ffmpeg_destroy();
   egl_destroy();
 }
 
-int x11_submit_decode_unit(PDECODE_UNIT decodeUnit) {
-  PLENTRY entry = decodeUnit->bufferList;
-  int length = 0;
+static int x11_decode_unit(PDECODE_UNIT decodeUnit, AVBufferRef* buffer) {
+  int ret = ffmpeg_submit_decode_unit(decodeUnit, buffer);
 
-  ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, decodeUnit->fullLength + AV_INPUT_BUFFER_PADDING_SIZE);
-
-  while (entry != NULL) {
-    neon_memcpy(ffmpeg_buffer+length, entry->data, entry->length);
-    length += entry->length;
-    entry = entry->next;
-  }
+  AVFrame* frame = ffmpeg_get_frame(true);
+  if (frame != NULL && write(pipefd[1], &frame, sizeof(void*)) != sizeof(void*))
+    ffmpeg_release_frame(frame);
 
-  ffmpeg_decode(ffmpeg_buffer, length);
+  return ret;
+}
 
-  AVFrame* frame = ffmpeg_get_frame(true);
-  if (frame != NULL)
-    write(pipefd[1], &frame, sizeof(void*));
+int x11_submit_decode_unit(PDECODE_UNIT decodeUnit) {
+  latency_record_host(LATENCY_SUBMIT, decodeUnit->receiveTimeMs);
+  if (use_decode_queue)
+    return decode_queue_submit(decodeUnit);
 
-  return DR_OK;
+  return x11_decode_unit(decodeUnit, NULL);
 }
 
 DECODER_RENDERER_CALLBACKS decoder_callbacks_x11 = {
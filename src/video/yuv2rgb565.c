@@ -0,0 +1,502 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "yuv2rgb565.h"
+
+#include <Limelight.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// Conversion runs row by row: the source rows needed for an output row are
+// resampled horizontally into line buffers, blended vertically and then
+// converted to RGB565, so besides the source planes nothing bigger than a
+// few output lines is touched. Colors are computed in fixed point, the
+// scalar reference reads the products from per-value tables while NEON
+// multiplies the same coefficients, which keeps both bit-exact.
+
+#define COEF_BITS 13
+#define COEF_ROUND (1 << (COEF_BITS - 1))
+#define WEIGHT_BITS 7
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+#define CACHED_LINES 2
+
+typedef struct _YUV_COEFFS {
+  int y_offset;
+  int16_t y;
+  int16_t rv;
+  int16_t gu;
+  int16_t gv;
+  int16_t bu;
+} YUV_COEFFS;
+
+typedef struct _AXIS_MAP {
+  int* first;
+  int* second;
+  uint8_t* weight;
+} AXIS_MAP, *PAXIS_MAP;
+
+typedef struct _PLANE_SAMPLER {
+  const uint8_t* plane;
+  int stride;
+  PAXIS_MAP columns;
+  PAXIS_MAP rows;
+  uint8_t* lines[CACHED_LINES];
+  int cached_rows[CACHED_LINES];
+  uint8_t* blended;
+} PLANE_SAMPLER, *PPLANE_SAMPLER;
+
+typedef struct _YUV_KERNELS {
+  const char* name;
+  void (*blend)(const uint8_t* first, const uint8_t* second, uint8_t* dst, int width, int weight);
+  void (*convert)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint16_t* dst, int width);
+} YUV_KERNELS;
+
+static YUV_COEFFS coeffs;
+static int32_t y_table[256], rv_table[256], gu_table[256], gv_table[256], bu_table[256];
+static int current_colorspace = -1;
+static bool current_full_range;
+
+static enum yuv_scaling scaling;
+static int src_width, src_height, dst_width, dst_height;
+static bool src_nv12;
+static AXIS_MAP luma_columns, luma_rows, chroma_columns, chroma_rows;
+static PLANE_SAMPLER samplers[3];
+static void* buffers;
+
+static void blend_line_c(const uint8_t* first, const uint8_t* second, uint8_t* dst, int width, int weight) {
+  for (int x = 0; x < width; x++)
+    dst[x] = (first[x] * (WEIGHT_ONE - weight) + second[x] * weight + WEIGHT_ONE / 2) >> WEIGHT_BITS;
+}
+
+static inline uint8_t clamp_pixel(int32_t value) {
+  value >>= COEF_BITS;
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static void convert_line_c(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint16_t* dst, int width) {
+  for (int x = 0; x < width; x++) {
+    int32_t luma = y_table[y[x]];
+    uint8_t r = clamp_pixel(luma + rv_table[v[x]]);
+    uint8_t g = clamp_pixel(luma - gu_table[u[x]] - gv_table[v[x]]);
+    uint8_t b = clamp_pixel(luma + bu_table[u[x]]);
+    dst[x] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+  }
+}
+
+static const YUV_KERNELS scalar_kernels = {"scalar", blend_line_c, convert_line_c};
+
+#ifdef __ARM_NEON
+static void blend_line_neon(const uint8_t* first, const uint8_t* second, uint8_t* dst, int width, int weight) {
+  uint8x8_t first_weight = vdup_n_u8(WEIGHT_ONE - weight);
+  uint8x8_t second_weight = vdup_n_u8(weight);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint16x8_t sum = vmull_u8(vld1_u8(first + x), first_weight);
+    sum = vmlal_u8(sum, vld1_u8(second + x), second_weight);
+    vst1_u8(dst + x, vrshrn_n_u16(sum, WEIGHT_BITS));
+  }
+
+  blend_line_c(first + x, second + x, dst + x, width - x, weight);
+}
+
+static inline uint8x8_t narrow_pixel(int32x4_t low, int32x4_t high) {
+  // Same truncating shift and clamp to 0..255 as clamp_pixel()
+  return vqmovn_u16(vcombine_u16(vqshrun_n_s32(low, COEF_BITS), vqshrun_n_s32(high, COEF_BITS)));
+}
+
+static void convert_line_neon(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint16_t* dst, int width) {
+  int16x8_t y_offset = vdupq_n_s16(coeffs.y_offset);
+  int16x8_t c_offset = vdupq_n_s16(128);
+  int32x4_t round = vdupq_n_s32(COEF_ROUND);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    int16x8_t y16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + x))), y_offset);
+    int16x8_t u16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + x))), c_offset);
+    int16x8_t v16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + x))), c_offset);
+
+    int32x4_t luma_low = vmlal_n_s16(round, vget_low_s16(y16), coeffs.y);
+    int32x4_t luma_high = vmlal_n_s16(round, vget_high_s16(y16), coeffs.y);
+
+    uint8x8_t r = narrow_pixel(vmlal_n_s16(luma_low, vget_low_s16(v16), coeffs.rv), vmlal_n_s16(luma_high, vget_high_s16(v16), coeffs.rv));
+    uint8x8_t g = narrow_pixel(vmlsl_n_s16(vmlsl_n_s16(luma_low, vget_low_s16(u16), coeffs.gu), vget_low_s16(v16), coeffs.gv),
+                               vmlsl_n_s16(vmlsl_n_s16(luma_high, vget_high_s16(u16), coeffs.gu), vget_high_s16(v16), coeffs.gv));
+    uint8x8_t b = narrow_pixel(vmlal_n_s16(luma_low, vget_low_s16(u16), coeffs.bu), vmlal_n_s16(luma_high, vget_high_s16(u16), coeffs.bu));
+
+    uint16x8_t pixels = vshll_n_u8(r, 8);
+    pixels = vsriq_n_u16(pixels, vshll_n_u8(g, 8), 5);
+    pixels = vsriq_n_u16(pixels, vshll_n_u8(b, 8), 11);
+    vst1q_u16(dst + x, pixels);
+  }
+
+  convert_line_c(y + x, u + x, v + x, dst + x, width - x);
+}
+
+static const YUV_KERNELS neon_kernels = {"NEON", blend_line_neon, convert_line_neon};
+static const YUV_KERNELS* kernels = &neon_kernels;
+#else
+static const YUV_KERNELS* kernels = &scalar_kernels;
+#endif
+
+static int16_t coefficient(double value) {
+  return (int16_t) (value * (1 << COEF_BITS) + 0.5);
+}
+
+void yuv2rgb565_set_colorspace(int colorspace, bool full_range) {
+  if (colorspace == current_colorspace && full_range == current_full_range)
+    return;
+
+  double kr, kb;
+  switch (colorspace) {
+  case COLORSPACE_REC_709:
+    kr = 0.2126;
+    kb = 0.0722;
+    break;
+  case COLORSPACE_REC_2020:
+    kr = 0.2627;
+    kb = 0.0593;
+    break;
+  default:
+    colorspace = COLORSPACE_REC_601;
+    /* fall-through */
+  case COLORSPACE_REC_601:
+    kr = 0.299;
+    kb = 0.114;
+    break;
+  }
+
+  double kg = 1.0 - kr - kb;
+  double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+  double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+
+  coeffs.y_offset = full_range ? 0 : 16;
+  coeffs.y = coefficient(y_scale);
+  coeffs.rv = coefficient(2.0 * (1.0 - kr) * c_scale);
+  coeffs.gu = coefficient(2.0 * kb * (1.0 - kb) / kg * c_scale);
+  coeffs.gv = coefficient(2.0 * kr * (1.0 - kr) / kg * c_scale);
+  coeffs.bu = coefficient(2.0 * (1.0 - kb) * c_scale);
+
+  for (int i = 0; i < 256; i++) {
+    y_table[i] = coeffs.y * (i - coeffs.y_offset) + COEF_ROUND;
+    rv_table[i] = coeffs.rv * (i - 128);
+    gu_table[i] = coeffs.gu * (i - 128);
+    gv_table[i] = coeffs.gv * (i - 128);
+    bu_table[i] = coeffs.bu * (i - 128);
+  }
+
+  current_colorspace = colorspace;
+  current_full_range = full_range;
+}
+
+static void map_axis(PAXIS_MAP map, int src_size, int dst_size, int step) {
+  int64_t scale = ((int64_t) src_size << 16) / dst_size;
+  for (int i = 0; i < dst_size; i++) {
+    // Sample at pixel centers so both edges are treated alike
+    int64_t position = i * scale + scale / 2;
+    int first, weight = 0;
+    if (scaling == YUV_SCALE_BILINEAR) {
+      position -= 1 << 15;
+      if (position < 0)
+        position = 0;
+
+      weight = (position >> (16 - WEIGHT_BITS)) & (WEIGHT_ONE - 1);
+    }
+    first = position >> 16;
+    if (first >= src_size - 1) {
+      first = src_size - 1;
+      weight = 0;
+    }
+
+    map->first[i] = first * step;
+    map->second[i] = (weight ? first + 1 : first) * step;
+    map->weight[i] = weight;
+  }
+}
+
+static void free_buffers(void) {
+  free(buffers);
+  buffers = NULL;
+  src_width = src_height = dst_width = dst_height = 0;
+}
+
+static int setup_geometry(PYUV_IMAGE src, int width, int height) {
+  if (src->width == src_width && src->height == src_height && src->nv12 == src_nv12 && width == dst_width && height == dst_height)
+    return 0;
+
+  free_buffers();
+
+  // Maps for luma and chroma columns and rows, then the line buffers of the three samplers
+  size_t map_size = 2 * (width + height) * (2 * sizeof(int) + 1);
+  size_t line_size = (width + 15) & ~15;
+  buffers = malloc(map_size + 3 * (CACHED_LINES + 1) * line_size);
+  if (buffers == NULL) {
+    fprintf(stderr, "Couldn't allocate conversion buffers\n");
+    return -1;
+  }
+
+  int* maps = buffers;
+  PAXIS_MAP axes[] = {&luma_columns, &chroma_columns, &luma_rows, &chroma_rows};
+  int sizes[] = {width, width, height, height};
+  for (int i = 0; i < 4; i++) {
+    axes[i]->first = maps;
+    axes[i]->second = maps + sizes[i];
+    maps += 2 * sizes[i];
+  }
+  uint8_t* bytes = (uint8_t*) maps;
+  for (int i = 0; i < 4; i++) {
+    axes[i]->weight = bytes;
+    bytes += sizes[i];
+  }
+
+  int step = src->nv12 ? 2 : 1;
+  map_axis(&luma_columns, src->width, width, 1);
+  map_axis(&chroma_columns, (src->width + 1) / 2, width, step);
+  map_axis(&luma_rows, src->height, height, 1);
+  map_axis(&chroma_rows, (src->height + 1) / 2, height, 1);
+
+  bytes = (uint8_t*) buffers + map_size;
+  for (int i = 0; i < 3; i++) {
+    samplers[i].columns = i == 0 ? &luma_columns : &chroma_columns;
+    samplers[i].rows = i == 0 ? &luma_rows : &chroma_rows;
+    for (int j = 0; j < CACHED_LINES; j++) {
+      samplers[i].lines[j] = bytes;
+      bytes += line_size;
+    }
+    samplers[i].blended = bytes;
+    bytes += line_size;
+  }
+
+  src_width = src->width;
+  src_height = src->height;
+  src_nv12 = src->nv12;
+  dst_width = width;
+  dst_height = height;
+  return 0;
+}
+
+static const uint8_t* fetch_line(PPLANE_SAMPLER sampler, int row) {
+  for (int i = 0; i < CACHED_LINES; i++) {
+    if (sampler->cached_rows[i] == row)
+      return sampler->lines[i];
+  }
+
+  // Output rows only move down, so the lowest cached row won't be needed again
+  int slot = sampler->cached_rows[0] < sampler->cached_rows[1] ? 0 : 1;
+  const uint8_t* src = sampler->plane + row * sampler->stride;
+  PAXIS_MAP map = sampler->columns;
+  uint8_t* dst = sampler->lines[slot];
+  for (int x = 0; x < dst_width; x++) {
+    int weight = map->weight[x];
+    uint8_t first = src[map->first[x]];
+    dst[x] = weight ? (first * (WEIGHT_ONE - weight) + src[map->second[x]] * weight + WEIGHT_ONE / 2) >> WEIGHT_BITS : first;
+  }
+
+  sampler->cached_rows[slot] = row;
+  return dst;
+}
+
+static const uint8_t* sample_row(PPLANE_SAMPLER sampler, int y, const YUV_KERNELS* kernels) {
+  const uint8_t* first = fetch_line(sampler, sampler->rows->first[y]);
+  int weight = sampler->rows->weight[y];
+  if (weight == 0)
+    return first;
+
+  const uint8_t* second = fetch_line(sampler, sampler->rows->second[y]);
+  kernels->blend(first, second, sampler->blended, dst_width, weight);
+  return sampler->blended;
+}
+
+static void convert(PYUV_IMAGE src, uint16_t* dst, int dst_pitch, int width, int height, const YUV_KERNELS* kernels) {
+  if (width <= 0 || height <= 0 || src->width <= 0 || src->height <= 0)
+    return;
+
+  if (setup_geometry(src, width, height) < 0)
+    return;
+
+  samplers[0].plane = src->planes[0];
+  samplers[0].stride = src->strides[0];
+  samplers[1].plane = src->planes[1];
+  samplers[1].stride = src->strides[1];
+  samplers[2].plane = src->nv12 ? src->planes[1] + 1 : src->planes[2];
+  samplers[2].stride = src->nv12 ? src->strides[1] : src->strides[2];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < CACHED_LINES; j++)
+      samplers[i].cached_rows[j] = -1;
+  }
+
+  for (int y = 0; y < height; y++) {
+    const uint8_t* luma = sample_row(&samplers[0], y, kernels);
+    const uint8_t* cb = sample_row(&samplers[1], y, kernels);
+    const uint8_t* cr = sample_row(&samplers[2], y, kernels);
+    kernels->convert(luma, cb, cr, (uint16_t*) ((uint8_t*) dst + y * dst_pitch), width);
+  }
+}
+
+void yuv2rgb565_convert(PYUV_IMAGE src, uint16_t* dst, int dst_pitch, int width, int height) {
+  convert(src, dst, dst_pitch, width, height, kernels);
+}
+
+int yuv2rgb565_convert_frame(const AVFrame* frame, uint16_t* dst, int dst_pitch, int width, int height) {
+  YUV_IMAGE image;
+  switch (frame->format) {
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_YUVJ420P:
+    image.nv12 = false;
+    break;
+  case AV_PIX_FMT_NV12:
+    image.nv12 = true;
+    break;
+  default:
+    return -1;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    image.planes[i] = frame->data[i];
+    image.strides[i] = frame->linesize[i];
+  }
+  image.width = frame->width;
+  image.height = frame->height;
+
+  int colorspace;
+  switch (frame->colorspace) {
+  case AVCOL_SPC_BT709:
+    colorspace = COLORSPACE_REC_709;
+    break;
+  case AVCOL_SPC_BT2020_NCL:
+  case AVCOL_SPC_BT2020_CL:
+    colorspace = COLORSPACE_REC_2020;
+    break;
+  default:
+    colorspace = COLORSPACE_REC_601;
+    break;
+  }
+  yuv2rgb565_set_colorspace(colorspace, frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P);
+
+  convert(&image, dst, dst_pitch, width, height, kernels);
+  return 0;
+}
+
+// Converts a uniform image with the selected kernels, wide enough for a
+// full NEON pass
+#define KNOWN_WIDTH 16
+static bool check_known_value(uint8_t y, uint8_t u, uint8_t v, int colorspace, bool full_range, uint16_t expected, const char* what) {
+  static uint8_t luma[KNOWN_WIDTH * 2], chroma[2][KNOWN_WIDTH / 2];
+  uint16_t pixels[KNOWN_WIDTH * 2];
+
+  memset(luma, y, sizeof(luma));
+  memset(chroma[0], u, sizeof(chroma[0]));
+  memset(chroma[1], v, sizeof(chroma[1]));
+
+  YUV_IMAGE image = {{luma, chroma[0], chroma[1]}, {KNOWN_WIDTH, KNOWN_WIDTH / 2, KNOWN_WIDTH / 2}, KNOWN_WIDTH, 2, false};
+  yuv2rgb565_set_colorspace(colorspace, full_range);
+  convert(&image, pixels, KNOWN_WIDTH * sizeof(uint16_t), KNOWN_WIDTH, 2, kernels);
+
+  for (int i = 0; i < KNOWN_WIDTH * 2; i++) {
+    if (pixels[i] != expected) {
+      fprintf(stderr, "YUV conversion self-test failed: %s is %04x instead of %04x with %s\n", what, pixels[i], expected, kernels->name);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool yuv2rgb565_self_test(bool thorough) {
+  #define TEST_WIDTH 53
+  #define TEST_HEIGHT 31
+  static uint8_t planes[3][TEST_WIDTH * TEST_HEIGHT];
+  static uint16_t expected[TEST_WIDTH * TEST_HEIGHT * 2], result[TEST_WIDTH * TEST_HEIGHT * 2];
+  static const int sizes[][2] = {{TEST_WIDTH, TEST_HEIGHT}, {37, 45}, {80, 17}};
+
+  enum yuv_scaling saved_scaling = scaling;
+  int saved_colorspace = current_colorspace;
+  bool saved_full_range = current_full_range;
+  bool passed = true;
+
+  free_buffers();
+
+  // Known values, black and white must come out exactly
+  scaling = YUV_SCALE_NEAREST;
+  passed &= check_known_value(16, 128, 128, COLORSPACE_REC_601, false, 0x0000, "limited range black");
+  passed &= check_known_value(235, 128, 128, COLORSPACE_REC_601, false, 0xFFFF, "limited range white");
+  passed &= check_known_value(255, 128, 128, COLORSPACE_REC_709, true, 0xFFFF, "full range white");
+  free_buffers();
+
+  if (thorough && passed && kernels != &scalar_kernels) {
+    uint32_t seed = 0x12345678;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < TEST_WIDTH * TEST_HEIGHT; j++) {
+        seed = seed * 1664525 + 1013904223;
+        planes[i][j] = seed >> 24;
+      }
+    }
+
+    for (int mode = 0; mode < 4 && passed; mode++) {
+      scaling = mode & 1 ? YUV_SCALE_BILINEAR : YUV_SCALE_NEAREST;
+      bool nv12 = mode & 2;
+      // Chroma rows are padded like decoder output, NV12 needs two bytes per chroma sample
+      YUV_IMAGE test = {{planes[0], planes[1], planes[2]}, {TEST_WIDTH, TEST_WIDTH + 1, TEST_WIDTH + 1}, TEST_WIDTH, TEST_HEIGHT, nv12};
+      for (int colorspace = COLORSPACE_REC_601; colorspace <= COLORSPACE_REC_2020 && passed; colorspace++) {
+        yuv2rgb565_set_colorspace(colorspace, colorspace == COLORSPACE_REC_709);
+        for (int size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+          int width = sizes[size][0], height = sizes[size][1];
+          // Geometry is cached, force the maps to be rebuilt for the new scaling mode
+          free_buffers();
+          convert(&test, expected, width * sizeof(uint16_t), width, height, &scalar_kernels);
+          convert(&test, result, width * sizeof(uint16_t), width, height, kernels);
+          if (memcmp(expected, result, width * height * sizeof(uint16_t)) != 0) {
+            fprintf(stderr, "YUV conversion self-test failed: %s output differs from scalar reference (%dx%d, mode %d)\n", kernels->name, width, height, mode);
+            passed = false;
+            break;
+          }
+        }
+      }
+    }
+
+  }
+
+  if (!passed)
+    kernels = &scalar_kernels;
+
+  free_buffers();
+  scaling = saved_scaling;
+  current_colorspace = -1;
+  if (saved_colorspace >= 0)
+    yuv2rgb565_set_colorspace(saved_colorspace, saved_full_range);
+
+  return passed;
+}
+
+int yuv2rgb565_init(enum yuv_scaling mode) {
+  scaling = mode;
+  free_buffers();
+  yuv2rgb565_set_colorspace(COLORSPACE_REC_601, false);
+
+  if (yuv2rgb565_self_test(false))
+    printf("Using %s YUV to RGB565 conversion with %s scaling\n", kernels->name, scaling == YUV_SCALE_BILINEAR ? "bilinear" : "nearest");
+
+  return 0;
+}
+
+void yuv2rgb565_destroy(void) {
+  free_buffers();
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <libavcodec/avcodec.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum yuv_scaling {YUV_SCALE_NEAREST, YUV_SCALE_BILINEAR};
+
+typedef struct _YUV_IMAGE {
+  const uint8_t* planes[3];
+  int strides[3];
+  int width;
+  int height;
+  // Chroma is interleaved in planes[1] instead of split over planes[1] and planes[2]
+  bool nv12;
+} YUV_IMAGE, *PYUV_IMAGE;
+
+int yuv2rgb565_init(enum yuv_scaling scaling);
+void yuv2rgb565_destroy(void);
+
+// Select the conversion tables, colorspace is one of the Limelight COLORSPACE_* values
+void yuv2rgb565_set_colorspace(int colorspace, bool full_range);
+
+// Convert and scale in a single pass, dst_pitch is in bytes
+void yuv2rgb565_convert(PYUV_IMAGE src, uint16_t* dst, int dst_pitch, int dst_width, int dst_height);
+
+// Convenience wrapper taking format, colorspace and range from a decoded frame.
+// Returns -1 when the frame has an unsupported pixel format.
+int yuv2rgb565_convert_frame(const AVFrame* frame, uint16_t* dst, int dst_pitch, int dst_width, int dst_height);
+
+// Checks known values with the selected kernels, cheap enough for every
+// start. thorough also compares the NEON kernels against the scalar
+// reference on random images, which yuv2rgb565-test does. On mismatch the
+// scalar path is used from then on.
+bool yuv2rgb565_self_test(bool thorough);
@@ -0,0 +1,179 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the YUV to RGB565 conversion against known values and, where
+// NEON is available, the NEON kernels against the scalar reference. Then
+// colored gradients are compared with a floating point reference for every
+// colorspace, range, chroma layout and scaling mode.
+
+#include "../src/video/yuv2rgb565.h"
+
+#include <Limelight.h>
+
+#include <stdio.h>
+
+#define SRC_WIDTH 48
+#define SRC_HEIGHT 32
+// Chroma rows are padded like decoder output, NV12 needs two bytes per sample
+#define CHROMA_STRIDE (SRC_WIDTH + 8)
+// Levels of 255 a channel may be off besides the RGB565 quantization, for
+// the fixed point coefficients and with bilinear scaling for the rounding
+// of the resampled values
+#define NEAREST_TOLERANCE 0.25
+#define BILINEAR_TOLERANCE 3.0
+
+static uint8_t luma[SRC_WIDTH * SRC_HEIGHT];
+static uint8_t chroma[2][CHROMA_STRIDE * SRC_HEIGHT / 2];
+static uint8_t interleaved[CHROMA_STRIDE * SRC_HEIGHT / 2];
+
+// Smooth but saturated, so resampling barely changes a value while a wrong
+// matrix or swapped chroma planes show up clearly
+static void fill_planes(void) {
+  for (int y = 0; y < SRC_HEIGHT; y++) {
+    for (int x = 0; x < SRC_WIDTH; x++)
+      luma[y * SRC_WIDTH + x] = 40 + 3 * x + 2 * y;
+  }
+
+  for (int y = 0; y < SRC_HEIGHT / 2; y++) {
+    for (int x = 0; x < SRC_WIDTH / 2; x++) {
+      uint8_t u = 60 + 5 * x + 3 * y, v = 200 - 4 * x - 2 * y;
+      chroma[0][y * CHROMA_STRIDE + x] = u;
+      chroma[1][y * CHROMA_STRIDE + x] = v;
+      interleaved[y * CHROMA_STRIDE + 2 * x] = u;
+      interleaved[y * CHROMA_STRIDE + 2 * x + 1] = v;
+    }
+  }
+}
+
+// Source position of an output pixel, sampled at pixel centers like the
+// conversion. Its 16.16 fixed point step is rounded down, so a position
+// right on a pixel edge falls into the pixel before it.
+static int reference_position(int src_size, int dst_size, int i, enum yuv_scaling scaling, double* weight) {
+  double position = (i + 0.5) * src_size / dst_size - 1e-6;
+  *weight = 0;
+  if (scaling == YUV_SCALE_BILINEAR) {
+    position = position < 0.5 ? 0 : position - 0.5;
+    *weight = position - (int) position;
+  }
+
+  int first = position;
+  if (first >= src_size - 1) {
+    first = src_size - 1;
+    *weight = 0;
+  }
+  return first;
+}
+
+static double reference_sample(const uint8_t* plane, int stride, int step, int width, int height, int dst_width, int dst_height, int x, int y, enum yuv_scaling scaling) {
+  double x_weight, y_weight;
+  int x0 = reference_position(width, dst_width, x, scaling, &x_weight);
+  int y0 = reference_position(height, dst_height, y, scaling, &y_weight);
+  int x1 = x_weight > 0 ? x0 + 1 : x0, y1 = y_weight > 0 ? y0 + 1 : y0;
+
+  double top = plane[y0 * stride + x0 * step] * (1 - x_weight) + plane[y0 * stride + x1 * step] * x_weight;
+  double bottom = plane[y1 * stride + x0 * step] * (1 - x_weight) + plane[y1 * stride + x1 * step] * x_weight;
+  return top * (1 - y_weight) + bottom * y_weight;
+}
+
+static double reference_channel(double value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static void reference_rgb(double y, double u, double v, int colorspace, bool full_range, double rgb[3]) {
+  double kr = 0.299, kb = 0.114;
+  if (colorspace == COLORSPACE_REC_709) {
+    kr = 0.2126;
+    kb = 0.0722;
+  } else if (colorspace == COLORSPACE_REC_2020) {
+    kr = 0.2627;
+    kb = 0.0593;
+  }
+  double kg = 1 - kr - kb;
+
+  double luma = full_range ? y : (y - 16) * 255 / 219;
+  double cb = full_range ? u - 128 : (u - 128) * 255 / 224;
+  double cr = full_range ? v - 128 : (v - 128) * 255 / 224;
+
+  rgb[0] = reference_channel(luma + 2 * (1 - kr) * cr);
+  rgb[1] = reference_channel(luma - 2 * kb * (1 - kb) / kg * cb - 2 * kr * (1 - kr) / kg * cr);
+  rgb[2] = reference_channel(luma + 2 * (1 - kb) * cb);
+}
+
+// A channel of bits holds the values that round to its level shifted left
+static bool channel_close(int level, int bits, double expected, double tolerance) {
+  double low = (level << (8 - bits)) - 0.5, high = ((level + 1) << (8 - bits)) - 0.5;
+  if (level == (1 << bits) - 1)
+    high = 255;
+  return expected >= low - tolerance && expected <= high + tolerance;
+}
+
+static bool check_reference(enum yuv_scaling scaling, bool nv12, int colorspace, bool full_range, int width, int height) {
+  static uint16_t pixels[SRC_WIDTH * SRC_HEIGHT * 4];
+  YUV_IMAGE image = {{luma, nv12 ? interleaved : chroma[0], chroma[1]}, {SRC_WIDTH, CHROMA_STRIDE, CHROMA_STRIDE}, SRC_WIDTH, SRC_HEIGHT, nv12};
+
+  yuv2rgb565_set_colorspace(colorspace, full_range);
+  yuv2rgb565_convert(&image, pixels, width * sizeof(uint16_t), width, height);
+
+  const uint8_t* u_plane = nv12 ? interleaved : chroma[0];
+  const uint8_t* v_plane = nv12 ? interleaved + 1 : chroma[1];
+  int step = nv12 ? 2 : 1;
+  double tolerance = scaling == YUV_SCALE_BILINEAR ? BILINEAR_TOLERANCE : NEAREST_TOLERANCE;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      double Y = reference_sample(luma, SRC_WIDTH, 1, SRC_WIDTH, SRC_HEIGHT, width, height, x, y, scaling);
+      double U = reference_sample(u_plane, CHROMA_STRIDE, step, SRC_WIDTH / 2, SRC_HEIGHT / 2, width, height, x, y, scaling);
+      double V = reference_sample(v_plane, CHROMA_STRIDE, step, SRC_WIDTH / 2, SRC_HEIGHT / 2, width, height, x, y, scaling);
+      double rgb[3];
+      reference_rgb(Y, U, V, colorspace, full_range, rgb);
+      uint16_t pixel = pixels[y * width + x];
+      if (!channel_close(pixel >> 11, 5, rgb[0], tolerance) || !channel_close(pixel >> 5 & 0x3F, 6, rgb[1], tolerance) ||
+          !channel_close(pixel & 0x1F, 5, rgb[2], tolerance)) {
+        fprintf(stderr, "Pixel %d,%d is %04x instead of %.1f,%.1f,%.1f (colorspace %d, %s range, %s, %s scaling, %dx%d)\n",
+                x, y, pixel, rgb[0], rgb[1], rgb[2], colorspace, full_range ? "full" : "limited", nv12 ? "NV12" : "planar",
+                scaling == YUV_SCALE_BILINEAR ? "bilinear" : "nearest", width, height);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int main(void) {
+  static const int sizes[][2] = {{SRC_WIDTH, SRC_HEIGHT}, {30, 20}, {75, 41}};
+
+  // Without yuv2rgb565_init, so a failed cheap check can't switch to the
+  // scalar kernels before the thorough comparison runs
+  bool passed = yuv2rgb565_self_test(true);
+
+  fill_planes();
+  for (int mode = 0; mode < 4; mode++) {
+    enum yuv_scaling scaling = mode & 1 ? YUV_SCALE_BILINEAR : YUV_SCALE_NEAREST;
+    bool nv12 = mode & 2;
+    // Also drops the cached geometry, which doesn't depend on the scaling mode
+    yuv2rgb565_init(scaling);
+    for (int colorspace = COLORSPACE_REC_601; colorspace <= COLORSPACE_REC_2020; colorspace++) {
+      for (int size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+        passed &= check_reference(scaling, nv12, colorspace, false, sizes[size][0], sizes[size][1]);
+        passed &= check_reference(scaling, nv12, colorspace, true, sizes[size][0], sizes[size][1]);
+      }
+    }
+  }
+  yuv2rgb565_destroy();
+
+  printf("YUV to RGB565 conversion %s\n", passed ? "passed" : "failed");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Decodes a capture recorded with the capture option without a host, to
+// benchmark decoder changes on any Linux machine
+
+#include "../src/capture.h"
+#include "../src/latency.h"
+#include "../src/video/ffmpeg.h"
+
+#include <Limelight.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define REPLAY_BUFFER_FRAMES 2
+
+static void usage(const char* name) {
+  printf("Usage: %s [options] FILE\n\n", name);
+  printf("\t-f\t\tDecode as fast as possible instead of at the recorded pace\n");
+  printf("\t-t <threads>\tNumber of decoder threads (default: online cores)\n");
+  printf("\t-c\t\tAllocate frames in the contiguous texture layout of the SDL renderer\n");
+}
+
+int main(int argc, char* argv[]) {
+  bool fast = false, contiguous = false;
+  int threads = ffmpeg_decode_threads();
+
+  int option;
+  while ((option = getopt(argc, argv, "ft:ch")) != -1) {
+    switch (option) {
+    case 'f':
+      fast = true;
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'c':
+      contiguous = true;
+      break;
+    default:
+      usage(argv[0]);
+      return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  CAPTURE_READER reader;
+  if (capture_open(&reader, argv[optind]) < 0)
+    return 1;
+
+  printf("Replaying %dx%d at %d fps with %d decoder thread%s%s\n", reader.header.width, reader.header.height, reader.header.fps,
+         threads, threads > 1 ? "s" : "", fast ? " as fast as possible" : "");
+
+  int perf_lvl = contiguous ? CONTIGUOUS_FRAMES : 0;
+  if (threads > 1)
+    perf_lvl |= reader.header.video_format & VIDEO_FORMAT_MASK_AV1 ? FRAME_THREADING : SLICE_THREADING;
+
+  latency_init();
+  if (ffmpeg_init(reader.header.video_format, reader.header.width, reader.header.height, perf_lvl, REPLAY_BUFFER_FRAMES, threads) < 0) {
+    fprintf(stderr, "Couldn't initialize video decoding\n");
+    capture_close(&reader);
+    return 1;
+  }
+  ffmpeg_set_frame_rate(reader.header.fps);
+
+  uint64_t units = 0, frames = 0, skipped = 0;
+  uint64_t first_receive = 0;
+  uint64_t start = latency_now_us();
+  bool waiting_for_idr = false;
+
+  PDECODE_UNIT decodeUnit;
+  while ((decodeUnit = capture_read(&reader)) != NULL) {
+    if (units++ == 0)
+      first_receive = decodeUnit->receiveTimeMs;
+
+    if (!fast) {
+      uint64_t due = start + (decodeUnit->receiveTimeMs - first_receive) * 1000;
+      uint64_t now = latency_now_us();
+      if (due > now)
+        usleep(due - now);
+    }
+
+    // Like the connection, drop everything up to the next IDR frame once the decoder asked for one
+    if (waiting_for_idr && decodeUnit->frameType != FRAME_TYPE_IDR) {
+      skipped++;
+      continue;
+    }
+    waiting_for_idr = false;
+
+    // Timestamps are taken relative to the replay, not to the recording
+    decodeUnit->receiveTimeMs = decodeUnit->enqueueTimeMs = LiGetMillis();
+    if (ffmpeg_submit_decode_unit(decodeUnit, NULL) == DR_NEED_IDR)
+      waiting_for_idr = true;
+
+    AVFrame* frame = ffmpeg_get_frame(false);
+    if (frame != NULL) {
+      frames++;
+      ffmpeg_release_frame(frame);
+    }
+  }
+
+  // Frame threads still hold the last frames, count them too
+  ffmpeg_flush();
+  AVFrame* frame;
+  while ((frame = ffmpeg_get_frame(false)) != NULL) {
+    frames++;
+    ffmpeg_release_frame(frame);
+  }
+
+  double seconds = (latency_now_us() - start) / 1000000.0;
+  printf("Decoded %llu frames from %llu units in %.2f s, %.1f fps", (unsigned long long) frames, (unsigned long long) units, seconds, seconds > 0 ? frames / seconds : 0);
+  if (skipped > 0)
+    printf(", %llu units skipped waiting for an IDR frame", (unsigned long long) skipped);
+  printf("\n");
+
+  latency_dump();
+  ffmpeg_destroy();
+  capture_close(&reader);
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    printf("Peak RSS: %ld KiB\n", usage.ru_maxrss);
+
+  return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Converts the splash PNG sequence (frame0001.png, frame0002.png, ...) into
+// the RGB565 pack played by sdl_splash, so the device never decodes a PNG
+// while the splash is on screen
+
+#include "../src/video/splash_screen.h"
+
+#include <png.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SPLASH_DEFAULT_FRAME_MS 40
+
+static void usage(const char* name) {
+  printf("Usage: %s [options] DIRECTORY OUTPUT\n\n", name);
+  printf("\t-d <ms>\t\tDuration of each frame (default: %d)\n", SPLASH_DEFAULT_FRAME_MS);
+  printf("\t-n\t\tKeep rows in file order, by default frames are flipped vertically like the PNG splash did\n");
+}
+
+static uint16_t rgb565(const png_byte* pixel) {
+  // Alpha is blended against the black screen behind the splash
+  unsigned int r = pixel[0] * pixel[3] / 255;
+  unsigned int g = pixel[1] * pixel[3] / 255;
+  unsigned int b = pixel[2] * pixel[3] / 255;
+  return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+int main(int argc, char* argv[]) {
+  int frame_ms = SPLASH_DEFAULT_FRAME_MS;
+  bool flip = true;
+
+  int option;
+  while ((option = getopt(argc, argv, "d:nh")) != -1) {
+    switch (option) {
+    case 'd':
+      frame_ms = atoi(optarg);
+      break;
+    case 'n':
+      flip = false;
+      break;
+    default:
+      usage(argv[0]);
+      exit(option == 'h' ? 0 : 1);
+    }
+  }
+
+  if (argc - optind != 2 || frame_ms <= 0 || frame_ms > UINT16_MAX) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  FILE* out = fopen(argv[optind + 1], "wb");
+  if (!out) {
+    perror(argv[optind + 1]);
+    exit(1);
+  }
+
+  SPLASH_PACK_HEADER header = {0};
+  header.magic = SPLASH_PACK_MAGIC;
+  header.version = SPLASH_PACK_VERSION;
+  header.frame_ms = frame_ms;
+  fwrite(&header, sizeof(header), 1, out);
+
+  png_bytep rgba = NULL;
+  uint16_t* row = NULL;
+  for (int number = 1;; number++) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/frame%04d.png", argv[optind], number);
+    if (access(path, R_OK) != 0)
+      break;
+
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, path)) {
+      fprintf(stderr, "%s: %s\n", path, image.message);
+      exit(1);
+    }
+    image.format = PNG_FORMAT_RGBA;
+
+    if (header.frame_count == 0) {
+      if (image.width > UINT16_MAX || image.height > UINT16_MAX) {
+        fprintf(stderr, "%s: %ux%u is too large\n", path, image.width, image.height);
+        exit(1);
+      }
+      header.width = image.width;
+      header.height = image.height;
+      rgba = malloc(PNG_IMAGE_SIZE(image));
+      row = malloc(header.width * sizeof(uint16_t));
+      if (!rgba || !row) {
+        fprintf(stderr, "Not enough memory\n");
+        exit(1);
+      }
+    } else if (image.width != header.width || image.height != header.height) {
+      fprintf(stderr, "%s: %ux%u differs from the first frame (%ux%u)\n", path, image.width, image.height, header.width, header.height);
+      exit(1);
+    }
+
+    if (!png_image_finish_read(&image, NULL, rgba, 0, NULL)) {
+      fprintf(stderr, "%s: %s\n", path, image.message);
+      exit(1);
+    }
+
+    for (unsigned int y = 0; y < header.height; y++) {
+      png_const_bytep line = rgba + (size_t) (flip ? header.height - 1 - y : y) * header.width * 4;
+      for (unsigned int x = 0; x < header.width; x++)
+        row[x] = rgb565(line + x * 4);
+
+      fwrite(row, sizeof(uint16_t), header.width, out);
+    }
+    header.frame_count++;
+  }
+
+  if (header.frame_count == 0) {
+    fprintf(stderr, "No frames found in %s\n", argv[optind]);
+    fclose(out);
+    remove(argv[optind + 1]);
+    exit(1);
+  }
+
+  rewind(out);
+  fwrite(&header, sizeof(header), 1, out);
+  if (fclose(out) != 0) {
+    perror(argv[optind + 1]);
+    exit(1);
+  }
+
+  printf("Packed %u frames of %ux%u at %d ms\n", header.frame_count, header.width, header.height, frame_ms);
+  free(rgba);
+  free(row);
+  return 0;
+}
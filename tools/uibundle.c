@@ -0,0 +1,272 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Builds the UI bundle mapped by the menu at startup: images converted to
+// the RGB565 panel format and glyph atlases of the menu font, so the device
+// doesn't decode PNG or TTF files to show the menu
+
+#include "../src/ui_bundle.h"
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_ttf.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UIBUNDLE_MAX_ENTRIES 64
+#define UIBUNDLE_ATLAS_WIDTH 512
+#define UIBUNDLE_DEFAULT_SIZES "16,24,26,30"
+
+typedef struct _UIBUNDLE_ITEM {
+  UI_BUNDLE_ENTRY entry;
+  uint8_t* data;
+} UIBUNDLE_ITEM;
+
+static UIBUNDLE_ITEM items[UIBUNDLE_MAX_ENTRIES];
+static int item_count;
+
+static void usage(const char* name) {
+  printf("Usage: %s [options] OUTPUT\n\n", name);
+  printf("\t-f <font>\tTTF font to rasterize into glyph atlases\n");
+  printf("\t-s <sizes>\tComma separated point sizes of the atlases (default: %s)\n", UIBUNDLE_DEFAULT_SIZES);
+  printf("\t-i <name=file>\tImage to convert, can be repeated (the menu uses top_banner)\n");
+}
+
+static UIBUNDLE_ITEM* add_item(const char* name, uint32_t type) {
+  if (item_count == UIBUNDLE_MAX_ENTRIES || strlen(name) >= UI_BUNDLE_NAME_LENGTH) {
+    fprintf(stderr, "Can't add %s to the bundle\n", name);
+    exit(1);
+  }
+
+  UIBUNDLE_ITEM* item = &items[item_count++];
+  memset(item, 0, sizeof(*item));
+  strcpy(item->entry.name, name);
+  item->entry.type = type;
+  return item;
+}
+
+// Images are composited on the black menu background
+static void add_image(const char* name, const char* path) {
+  SDL_Surface* image = IMG_Load(path);
+  SDL_Surface* argb = image ? SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0) : NULL;
+  if (argb == NULL) {
+    fprintf(stderr, "%s: %s\n", path, IMG_GetError());
+    exit(1);
+  }
+
+  UIBUNDLE_ITEM* item = add_item(name, UI_BUNDLE_TYPE_IMAGE);
+  item->entry.width = argb->w;
+  item->entry.height = argb->h;
+  item->entry.size = argb->w * argb->h * 2;
+  item->data = malloc(item->entry.size);
+
+  uint16_t* dst = (uint16_t*) item->data;
+  for (int y = 0; y < argb->h; y++) {
+    const Uint32* src = (const Uint32*) ((const Uint8*) argb->pixels + y * argb->pitch);
+    for (int x = 0; x < argb->w; x++) {
+      unsigned int a = src[x] >> 24;
+      unsigned int r = (src[x] >> 16 & 0xff) * a / 255;
+      unsigned int g = (src[x] >> 8 & 0xff) * a / 255;
+      unsigned int b = (src[x] & 0xff) * a / 255;
+      *dst++ = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+  }
+
+  SDL_FreeSurface(argb);
+  SDL_FreeSurface(image);
+}
+
+// Every glyph is rendered on its own like TTF_RenderText lays out a label
+// and cropped to its coverage, then packed in rows into the atlas
+static void add_font(const char* path, int size) {
+  TTF_Font* font = TTF_OpenFont(path, size);
+  if (font == NULL) {
+    fprintf(stderr, "%s: %s\n", path, TTF_GetError());
+    exit(1);
+  }
+
+  UI_BUNDLE_FONT_HEADER* header = calloc(1, sizeof(UI_BUNDLE_FONT_HEADER));
+  header->size = size;
+  header->line_height = TTF_FontHeight(font);
+
+  SDL_Surface* glyphs[UI_BUNDLE_GLYPHS] = {0};
+  int x = 0, y = 0, row_height = 0;
+  for (int i = 0; i < UI_BUNDLE_GLYPHS; i++) {
+    int c = UI_BUNDLE_FIRST_GLYPH + i;
+    int minx, maxx, miny, maxy, advance;
+    // No glyphs for C1 control characters
+    if ((c >= 0x7f && c < 0xa0) || TTF_GlyphMetrics(font, c, &minx, &maxx, &miny, &maxy, &advance) != 0)
+      continue;
+
+    UI_BUNDLE_GLYPH* glyph = &header->glyphs[i];
+    glyph->advance = advance;
+
+    char text[2] = {(char) c, '\0'};
+    SDL_Surface* rendered = TTF_RenderText_Blended(font, text, (SDL_Color) {255, 255, 255, 255});
+    SDL_Surface* surface = rendered ? SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ARGB8888, 0) : NULL;
+    SDL_FreeSurface(rendered);
+    if (surface == NULL)
+      continue;
+
+    int left = surface->w, top = surface->h, right = 0, bottom = 0;
+    for (int py = 0; py < surface->h; py++) {
+      const Uint32* row = (const Uint32*) ((const Uint8*) surface->pixels + py * surface->pitch);
+      for (int px = 0; px < surface->w; px++) {
+        if (row[px] >> 24) {
+          left = SDL_min(left, px);
+          right = SDL_max(right, px + 1);
+          top = SDL_min(top, py);
+          bottom = SDL_max(bottom, py + 1);
+        }
+      }
+    }
+
+    if (right <= left) {
+      SDL_FreeSurface(surface);
+      continue;
+    }
+
+    glyph->left = left;
+    glyph->top = top;
+    glyph->w = right - left;
+    glyph->h = bottom - top;
+    if (x + glyph->w > UIBUNDLE_ATLAS_WIDTH) {
+      x = 0;
+      y += row_height + 1;
+      row_height = 0;
+    }
+    glyph->x = x;
+    glyph->y = y;
+    x += glyph->w + 1;
+    row_height = SDL_max(row_height, glyph->h);
+    glyphs[i] = surface;
+  }
+  int height = y + row_height;
+
+  char name[UI_BUNDLE_NAME_LENGTH];
+  snprintf(name, sizeof(name), "font%d", size);
+  UIBUNDLE_ITEM* item = add_item(name, UI_BUNDLE_TYPE_FONT);
+  item->entry.width = UIBUNDLE_ATLAS_WIDTH;
+  item->entry.height = height;
+  item->entry.size = sizeof(UI_BUNDLE_FONT_HEADER) + UIBUNDLE_ATLAS_WIDTH * height;
+  item->data = calloc(1, item->entry.size);
+  memcpy(item->data, header, sizeof(UI_BUNDLE_FONT_HEADER));
+
+  uint8_t* atlas = item->data + sizeof(UI_BUNDLE_FONT_HEADER);
+  for (int i = 0; i < UI_BUNDLE_GLYPHS; i++) {
+    if (glyphs[i] == NULL)
+      continue;
+
+    const UI_BUNDLE_GLYPH* glyph = &header->glyphs[i];
+    for (int py = 0; py < glyph->h; py++) {
+      const Uint32* src = (const Uint32*) ((const Uint8*) glyphs[i]->pixels + (glyph->top + py) * glyphs[i]->pitch) + glyph->left;
+      uint8_t* dst = atlas + (glyph->y + py) * UIBUNDLE_ATLAS_WIDTH + glyph->x;
+      for (int px = 0; px < glyph->w; px++)
+        dst[px] = src[px] >> 24;
+    }
+    SDL_FreeSurface(glyphs[i]);
+  }
+
+  printf("Font %d: %dx%d atlas, %d pixel lines\n", size, UIBUNDLE_ATLAS_WIDTH, height, header->line_height);
+  free(header);
+  TTF_CloseFont(font);
+}
+
+int main(int argc, char* argv[]) {
+  const char* font = NULL;
+  char sizes[256] = UIBUNDLE_DEFAULT_SIZES;
+
+  if (SDL_Init(0) != 0 || TTF_Init() != 0) {
+    fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+    exit(1);
+  }
+
+  int option;
+  while ((option = getopt(argc, argv, "f:s:i:h")) != -1) {
+    switch (option) {
+    case 'f':
+      font = optarg;
+      break;
+    case 's':
+      snprintf(sizes, sizeof(sizes), "%s", optarg);
+      break;
+    case 'i':
+    {
+      char* separator = strchr(optarg, '=');
+      if (separator == NULL) {
+        usage(argv[0]);
+        exit(1);
+      }
+      *separator = '\0';
+      add_image(optarg, separator + 1);
+      break;
+    }
+    default:
+      usage(argv[0]);
+      exit(option == 'h' ? 0 : 1);
+    }
+  }
+
+  if (argc - optind != 1) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  if (font) {
+    for (char* size = strtok(sizes, ","); size; size = strtok(NULL, ","))
+      add_font(font, atoi(size));
+  }
+
+  FILE* out = fopen(argv[optind], "wb");
+  if (!out) {
+    perror(argv[optind]);
+    exit(1);
+  }
+
+  UI_BUNDLE_HEADER header = {UI_BUNDLE_MAGIC, UI_BUNDLE_VERSION, item_count};
+  uint32_t offset = sizeof(header) + item_count * sizeof(UI_BUNDLE_ENTRY);
+  for (int i = 0; i < item_count; i++) {
+    offset = (offset + 3) & ~3u;
+    items[i].entry.offset = offset;
+    offset += items[i].entry.size;
+  }
+
+  fwrite(&header, sizeof(header), 1, out);
+  for (int i = 0; i < item_count; i++)
+    fwrite(&items[i].entry, sizeof(UI_BUNDLE_ENTRY), 1, out);
+
+  static const uint8_t padding[4];
+  for (int i = 0; i < item_count; i++) {
+    fwrite(padding, 1, items[i].entry.offset - ftell(out), out);
+    fwrite(items[i].data, 1, items[i].entry.size, out);
+    free(items[i].data);
+  }
+
+  if (fclose(out) != 0) {
+    perror(argv[optind]);
+    exit(1);
+  }
+
+  printf("Bundled %d entries in %u bytes\n", item_count, offset);
+  TTF_Quit();
+  SDL_Quit();
+  return 0;
+}